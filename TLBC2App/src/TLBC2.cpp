@@ -1,11 +1,22 @@
+#include <atomic>
+#include <algorithm>
+#include <cmath>
 #include <cstring>
-#include <functional>
+#include <deque>
+#include <iterator>
 #include <iostream>
+#include <map>
+#include <memory>
 #include <string>
+#include <tuple>
 #include <type_traits>
-#include <unordered_map>
-#include <variant>
+#include <utility>
 
+#include <epicsGuard.h>
+#include <epicsMessageQueue.h>
+#include <epicsMutex.h>
+#include <epicsTime.h>
+#include <epicsTimer.h>
 #include <iocsh.h>
 
 #include <ADDriver.h>
@@ -14,6 +25,33 @@
 #include <TLBC2.h>
 #include <TLBC1_Calculations.h>
 
+#include "TLBC2Accumulate.h"
+#include "TLBC2Attributes.h"
+#include "TLBC2Background.h"
+#include "TLBC2Binning.h"
+#include "TLBC2Codec.h"
+#include "TLBC2Devices.h"
+#include "TLBC2Exposure.h"
+#include "TLBC2FramePool.h"
+#include "TLBC2Latency.h"
+#include "TLBC2Moments.h"
+#include "TLBC2Operations.h"
+#include "TLBC2Profiles.h"
+#include "TLBC2Ring.h"
+#include "TLBC2Scheduler.h"
+#include "TLBC2Stability.h"
+#include "TLBC2Workers.h"
+
+#ifdef TLBC2_SIM
+#include "TLBC2Sim.h"
+#endif
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/resource.h>
+#endif
+
 #include <alarm.h>
 #include <epicsExport.h> // defines epicsExportSharedSymbols, do not move
 
@@ -23,6 +61,23 @@ static_assert(std::is_same_v<ViReal64, epicsFloat64>);
 static_assert(std::is_same_v<ViChar, char>);
 
 
+/* Shared by all ports, so each device is enumerated and opened once */
+static DeviceDirectory device_directory;
+
+/* The drivers by port name, for the iocsh commands. ADDriver is a private
+ * base, so the asynPortDriver from findAsynPortDriver cannot be cast */
+class ADTLBC2;
+static epicsMutex drivers_lock;
+static std::map<std::string, ADTLBC2 *> port_drivers;
+
+static ADTLBC2 *findTLBC2(const char *port)
+{
+    epicsGuard<epicsMutex> guard(drivers_lock);
+    auto found = port_drivers.find(port ? port : "");
+
+    return found == port_drivers.end() ? nullptr : found->second;
+}
+
 /* Define these as vendor headers do not provide them */
 enum ambient_light_correction_status {
     AMBIENT_LIGHT_CORRECTION_AVAILABLE,
@@ -30,119 +85,828 @@ enum ambient_light_correction_status {
     AMBIENT_LIGHT_CORRECTION_FAILED,
 };
 
-template<typename T, typename V>
-std::function<ViStatus(ViSession, T*)> create_getter_wrapper(std::function<ViStatus(ViSession, V*)> getter)
-{
-    return [getter](ViSession session, T *value) {
-        V tmp = 0;
-        auto rv = getter(session, &tmp);
-        *value = tmp;
-        return rv;
-    };
-}
-
-template<typename T, typename V>
-std::function<ViStatus(ViSession, T)> create_setter_wrapper(std::function<ViStatus(ViSession, V)> setter)
-{
-    return [setter](ViSession session, T value) {
-        return setter(session, (V)value);
-    };
-}
+/* Values of AMBIENT_LIGHT_CORRECTION_STATUS */
+enum {
+    AmbientNeverRun,
+    AmbientComputed,
+    AmbientComputing,
+    AmbientFailed,
+};
 
-template<typename T>
+/* A device setting with the SDK functions that access it, bound at compile
+ * time. T is the type of the asyn parameter, V the one the SDK uses; Set and
+ * Range are nullptr for settings that are read-only or have no range */
+template<typename T, typename V, auto Get, auto Set = nullptr, auto Range = nullptr>
 class Parameter {
-    std::function<ViStatus(ViSession, T*)> getter;
-    std::function<ViStatus(ViSession, T)> setter;
-    std::function<ViStatus(ViSession, T*, T*)> range_getter;
+    /* Last readback and valid range. The cache is only accessed with the
+     * port lock held, the SDK calls that fill it are made without it */
+    T value = 0;
+    epicsUInt64 value_time = 0;     /* epicsMonotonicGet(), 0 if not cached */
+    T min = 0, max = 0;
+    bool range_cached = false;
 
 public:
-    const std::string name;
+    using value_type = T;
 
-    Parameter(const std::string name,
-              std::function<ViStatus(ViSession, T*)> getter,
-              std::function<ViStatus(ViSession, T)> setter,
-              std::function<ViStatus(ViSession, T*, T*)> range_getter = {})
-        : name(name), getter(getter), setter(setter), range_getter(range_getter) {}
+    static constexpr bool settable = !std::is_null_pointer_v<decltype(Set)>;
+    static constexpr bool has_range = !std::is_null_pointer_v<decltype(Range)>;
 
-    ViStatus get(ViSession instr, T& value)
+    const char *const name;
+    int reason = -1;    /* asyn parameter, set by bindParam */
+
+    Parameter(const char *name): name(name) {}
+
+    ViStatus get(ViSession instr, T &value)
     {
-        return getter(instr, &value);
+        V tmp = 0;
+        ViStatus status = Get(instr, &tmp);
+
+        value = tmp;
+        return status;
     }
 
     ViStatus set(ViSession instr, T value)
     {
-        T min, max;
+        static_assert(settable);
+        return Set(instr, (V)value);
+    }
 
-        if (range_getter) {
-            ViStatus status = range_getter(instr, &min, &max);
-            if (status != VI_SUCCESS)
-                return status;
+    ViStatus get_range(ViSession instr, T &min, T &max)
+    {
+        static_assert(has_range);
+        V vmin = 0, vmax = 0;
+        ViStatus status = Range(instr, &vmin, &vmax);
 
-            /* TODO: handle this with DRVL and DRVH instead */
-            if (value < min || value > max)
-                throw std::range_error("value ouside range [" +
-                                       std::to_string(min) + ", " +
-                                       std::to_string(max) + "]");
-        }
+        min = vmin;
+        max = vmax;
+        return status;
+    }
+    static void check_range(T value, T min, T max)
+    {
+        /* TODO: handle this with DRVL and DRVH instead */
+        if (value < min || value > max)
+            throw std::range_error("value ouside range [" +
+                                   std::to_string(min) + ", " +
+                                   std::to_string(max) + "]");
+    }
+
+    /* Returns true and the cached readback if it is at most max_age
+     * seconds old */
+    bool cached(T &value, double max_age) const
+    {
+        if (!value_time || (epicsMonotonicGet() - value_time) * 1e-9 > max_age)
+            return false;
 
-        return setter(instr, value);
+        value = this->value;
+        return true;
     }
+
+    void store(T value)
+    {
+        this->value = value;
+        value_time = epicsMonotonicGet();
+    }
+
+    void invalidate()
+    {
+        value_time = 0;
+    }
+
+    bool cached_range(T &min, T &max) const
+    {
+        min = this->min;
+        max = this->max;
+        return range_cached;
+    }
+
+    void store_range(T min, T max)
+    {
+        this->min = min;
+        this->max = max;
+        range_cached = true;
+    }
+
+    void invalidate_range()
+    {
+        range_cached = false;
+    }
+};
+
+/* Releases an asynPortDriver's lock for as long as it is in scope */
+class PortUnlocker {
+    asynPortDriver &driver;
+
+public:
+    PortUnlocker(asynPortDriver &driver): driver(driver) { driver.unlock(); }
+    ~PortUnlocker() { driver.lock(); }
 };
 
 class epicsShareClass ADTLBC2: ADDriver, epicsThreadRunable {
-    ViSession instr = TLBC2_INV_DEVICE_HANDLE;
-    TLBC1_Calculations scan_data;
-    ViUInt8 image_data[TLBC1_MAX_ROWS * TLBC1_MAX_COLUMNS * 2];
+    /* All SDK calls on the device session go through the scheduler. They
+     * are made with the port lock released, which is only taken to publish
+     * their results */
+    DeviceScheduler device;
+
+    /* Hardware ROI as last read back with get_roi, only accessed from device
+     * commands. Frames are captured at this size */
+    ViUInt16 roi_left = 0;
+    ViUInt16 roi_top = 0;
+    ViUInt16 roi_width = TLBC1_MAX_COLUMNS;
+    ViUInt16 roi_height = TLBC1_MAX_ROWS;
+
+    /* Settings of the auto ROI, read with the port lock held for use within
+     * a device command */
+    struct AutoRoiSettings {
+        bool enabled;
+        double margin;
+        double max_rate;
+        int max_x, max_y;
+    };
+
+    /* Settings of the driver's exposure control, read with the port lock
+     * held for use by the capture thread */
+    struct ExposureControl {
+        bool enabled;
+        double target;          /* fraction of full scale */
+        double percentile;
+        double tolerance;       /* relative to the target */
+        ExposureLimits limits;
+        bool range_cached;      /* limits has the exposure time range */
+        ExposureSetting current;
+    };
+
+    /* BC207 and BC210 sensors digitize 12 bits, sent as 2 bytes per pixel */
+    static constexpr unsigned full_scale_16 = 4095;
+    static constexpr double min_attenuation = 0., max_attenuation = 100.;
+
+    /* Exposure control state of the capture thread. A change computed from
+     * one frame is applied before the next one is requested */
+    ExposureSetting exposure_change = {};
+    bool exposure_change_pending = false;
+    bool exposure_converging = false;
+    epicsUInt64 exposure_converge_start = 0;
+    unsigned exposure_converge_frames = 0;
+
+    /* An ROI written through MinX, MinY, SizeX and SizeY */
+    struct RoiRequest {
+        int minx, miny, sizex, sizey;
+        epicsUInt64 time;       /* of the first write, for the apply latency */
+    };
+
+    /* Values of ROI_COMMIT */
+    enum {
+        RoiCommitCoalesce,      /* after ROI_COALESCE_TIME without writes */
+        RoiCommitExplicit,      /* on ROI_APPLY */
+    };
+
+    /* ROI being written, and one committed during an acquisition that waits
+     * for the capture thread. Only accessed with the port lock held */
+    RoiRequest roi_staged = {};
+    bool roi_staged_pending = false;
+    RoiRequest roi_deferred = {};
+    bool roi_deferred_pending = false;
+
+    /* The beam as last seen by the capture thread, in sensor pixels */
+    struct AutoRoiBeam {
+        enum { Unknown, Lost, Found } state;
+        double x, y;
+        double width_x, width_y;
+    };
+
+    /* Auto ROI state, only accessed by the capture thread */
+    static constexpr int auto_roi_min_size = 64;
+    AutoRoiBeam auto_roi_beam = {};
+    epicsUInt64 auto_roi_time = 0;      /* of the last change */
+    int auto_roi_changes = 0;
+    double auto_roi_seconds = 0;        /* spent changing the ROI */
+
+    /* A captured frame on its way from the capture thread to the publisher */
+    struct Frame {
+        NDArray *image;
+        TLBC1_Calculations scan_data;   /* zeroed in MomentsDriver mode */
+        ViReal64 exposure_time;     /* negative when not read back */
+        bool calculated;            /* false if scan_data and moments are unset */
+        int moments_source;
+        BeamMoments moments;        /* unset in MomentsSDK mode */
+        int accumulated;            /* captures in the frame, 0 if not accumulated */
+        bool burst;                 /* published by a burst */
+        int burst_frame;            /* relative to the burst trigger */
+    };
+
+    /* A published frame waiting to be binned for the preview */
+    struct PreviewRequest {
+        NDArray *image;
+        int binning;
+        int mode;
+    };
+
+    /* Values of PREVIEW_MODE */
+    enum {
+        PreviewSum,
+        PreviewMean,
+    };
+
+    /* Axes of the PROFILE_* parameters */
+    enum {
+        ProfileX,
+        ProfileY,
+        NumProfiles
+    };
+
+    /* Beam results of one calculated frame for the RESULTS_* waveforms */
+    struct ResultSample {
+        epicsInt32 frame;       /* NDArray uniqueId */
+        double values[7];       /* indexed by the enum below */
+    };
+
+    enum {
+        ResultTimestamp,
+        ResultCentroidX,
+        ResultCentroidY,
+        ResultWidthX,
+        ResultWidthY,
+        ResultSaturation,
+        ResultPower,
+        NumResults
+    };
+
+    static_assert(NumResults == std::size(ResultSample{}.values));
+
+    /* Results whose stability is accumulated, in STABILITY_* order */
+    static constexpr int stability_results[] = {
+        ResultCentroidX, ResultCentroidY, ResultWidthX, ResultWidthY,
+    };
+    static constexpr int num_stability_channels = std::size(stability_results);
+
+    enum {
+        StabilityMean,
+        StabilityRms,
+        StabilityMin,
+        StabilityMax,
+        StabilityPeakToPeak,
+        NumStabilityStats
+    };
+
+    /* Timed stages of the acquisition loop, in LATENCY_* order */
+    enum {
+        StageRequest,       /* request_new_measurement */
+        StageScanData,      /* get_scan_data */
+        StageAlloc,         /* NDArray allocation */
+        StageGetImage,      /* get_image */
+        StageCopy,          /* copy after a wrong size prediction */
+        StageBackground,    /* dark frame capture or subtraction */
+        StageMoments,       /* driver moments */
+        StageCapture,       /* all of acquire_image */
+        StageAccumulate,    /* adding the frame to the accumulated frame */
+        StageQueue,         /* handing the frame to the publisher */
+        StageProfiles,      /* projecting and fitting the profiles */
+        StageAttributes,    /* getAttributes and the beam attributes */
+        StageCodec,         /* compressing the frame */
+        StageCallbacks,     /* plugin callbacks */
+        StagePeriodWait,    /* waiting for the acquire period */
+        StageLockWait,      /* taking the port lock back after the wait */
+        NumStages
+    };
+
+    /* Values of MOMENTS_SOURCE */
+    enum {
+        MomentsSDK,         /* beam results from the SDK calculations only */
+        MomentsDriver,      /* computed by the driver, SDK calculations skipped */
+        MomentsCrossCheck,  /* SDK results, compared against the driver's */
+    };
+
+    /* Values of CODEC */
+    enum {
+        CodecNone,
+        CodecBSLZ4,         /* bitshuffle + LZ4, see TLBC2Codec.h */
+    };
+
+    /* Values of FRAME_POOL_POLICY */
+    enum {
+        PoolBlock,          /* wait for a frame to be released */
+        PoolDropNewest,     /* skip capturing the frame */
+        PoolDropOldest,     /* discard the oldest frame not yet published */
+    };
+
+    /* Values of PERIOD_MODE */
+    enum {
+        PeriodAcquirePeriod,    /* a frame every AcquirePeriod */
+        PeriodFastest,          /* the next frame as soon as possible */
+    };
+
+    /* Frame start deadlines on the monotonic clock, each one period after
+     * the previous deadline rather than the previous start, so that periodic
+     * acquisition does not drift. Only accessed by the capture thread */
+    epicsUInt64 frame_deadline = 0;
+    epicsUInt64 frame_start = 0;        /* of the previous frame, 0 if none */
+    int period_overruns = 0;
+    double period_lateness_max = 0;     /* seconds */
+    size_t period_count = 0;            /* Welford's statistics of the intervals */
+    double period_mean = 0, period_m2 = 0;
+
+    /* The SDK returns at most 2 bytes per pixel; image_bpp is what the last
+     * frame used and is the prediction for the next one */
+    static constexpr size_t max_bytes_per_pixel = 2;
+    ViUInt8 image_bpp = max_bytes_per_pixel;
+
+    /* The largest image the SDK returns, for when the ROI is not known */
+    static constexpr size_t max_frame_size =
+        (size_t)TLBC1_MAX_COLUMNS * TLBC1_MAX_ROWS * max_bytes_per_pixel;
+
+    /* The attributes selected by ATTRIBUTE_SET, only accessed with the
+     * port lock held */
+    FrameAttributes frame_attributes;
+
+    /* Every SDK call goes through handle_tlbc2_err, from any thread */
+    std::atomic<epicsUInt32> sdk_calls{0};
+    epicsUInt32 cache_hits = 0;
+    epicsUInt32 cache_misses = 0;
+
+    /* When the capture thread last read back the exposure time */
+    epicsUInt64 exposure_read_time = 0;
+
+    /* Calculation decimation state of the capture thread */
+    unsigned frames_since_calc = 0;
+    epicsUInt64 calc_time = 0;      /* 0 until the first calculated frame */
+    int invalid_scans = 0;
+
+    /* Rate measurement of the publisher, only accessed with the port lock
+     * held */
+    epicsUInt64 rate_start = 0;
+    unsigned rate_frames = 0;
+    unsigned rate_calcs = 0;
+    bool rate_full_frames = true;
+    double full_frame_fps = 0;
 
     epicsEvent start_acquire_event;
     epicsEvent stop_acquire_event;
     epicsThread acq_thread;
 
-    std::unordered_map<int, std::variant<Parameter<ViInt32>, Parameter<ViReal64>>> params;
+    /* Frames captured but not yet published. The queue is short, since each
+     * frame holds a pool buffer */
+    static constexpr unsigned frame_queue_size = 4;
+    static constexpr int default_frame_pool_size = 16;
+    epicsMessageQueue frame_queue;
+    FramePool frame_pool;
+    epicsEvent publish_done_event;
+    bool capturing = false;
+
+    struct Publisher: epicsThreadRunable {
+        ADTLBC2 &driver;
+
+        Publisher(ADTLBC2 &driver): driver(driver) {}
+        void run() override { driver.publish_frames(); }
+    } publisher;
+    epicsThread publish_thread;
+
+    /* Latest frame offered to the preview thread. A newer frame replaces
+     * one that has not been picked up yet, so the preview never holds back
+     * the publisher */
+    epicsMutex preview_mutex;
+    PreviewRequest preview_request = {};
+    epicsEvent preview_event;
+
+    /* Preview rate limit and drop count, only accessed with the port lock
+     * held */
+    epicsUInt64 preview_time = 0;
+    int preview_dropped = 0;
+
+    /* Results of calculated frames, pushed by the publisher and published
+     * in batches of up to results_batch_size (the waveforms' NELM) by the
+     * results thread */
+    static constexpr size_t results_ring_size = 8192;
+    static constexpr size_t results_batch_size = 1024;
+    SpscRing<ResultSample, results_ring_size> results_ring;
+    epicsEvent results_event;
+    int results_overruns = 0;   /* only accessed with the port lock held */
+
+    /* A batch being published, only accessed by the results thread */
+    epicsFloat64 results_batch[NumResults][results_batch_size];
+    epicsInt32 results_batch_frames[results_batch_size];
+
+    /* Pointing stability of the published results, only accessed with the
+     * port lock held */
+    static constexpr int max_stability_window = 1000000;
+    StabilityAccumulator stability[num_stability_channels];
+    size_t stability_samples = 0;       /* since the last reset */
+    double stability_first_time = 0;    /* NDArray timeStamp of the first sample */
+    double stability_last_time = 0;
+    epicsUInt64 stability_publish_time = 0;
+
+    struct ResultsStreamer: epicsThreadRunable {
+        ADTLBC2 &driver;
+
+        ResultsStreamer(ADTLBC2 &driver): driver(driver) {}
+        void run() override { driver.stream_results(); }
+    } results_streamer;
+    epicsThread results_thread;
+
+    struct Previewer: epicsThreadRunable {
+        ADTLBC2 &driver;
+
+        Previewer(ADTLBC2 &driver): driver(driver) {}
+        void run() override { driver.preview_frames(); }
+    } previewer;
+    epicsThread preview_thread;
+
+    /* Recorded from any thread without locking */
+    LatencyHistogram latency[NumStages];
+    epicsUInt64 latency_publish_time = 0;   /* only accessed with the port lock held */
+
+    /* Threads for the driver's own per-frame computations */
+    static constexpr unsigned max_workers = 8;
+    WorkerPool workers;
+    WorkerPool publish_workers; /* used by the publisher */
+
+    /* Profiles of the last published frame, only used by the publisher */
+    ProfileProjector profiles;
+
+    /* Dark frames for background subtraction. The set is replaced, not
+     * modified, under the port lock, and the capture thread works on the
+     * one it took at the start of a frame */
+    std::shared_ptr<const DarkFrames> dark_frames = std::make_shared<DarkFrames>();
+    static constexpr int max_background_frames = 1000;
+
+    /* Dark frame being accumulated, only used by the capture thread */
+    struct DarkCapture {
+        DarkFrame frame;    /* settings of the frames, data unused */
+        std::vector<epicsUInt32> sum;
+        int count = 0;
+    } dark_capture;
+
+    /* Values of ACCUMULATE_MODE */
+    enum {
+        AccumulateSum,
+        AccumulateMean,
+    };
+
+    /* Captures being accumulated into one frame, only used by the capture
+     * thread. The sums of 16 bit pixels cannot overflow */
+    static constexpr int max_accumulate_frames = 1000;
+    struct Accumulation {
+        NDArray *sum = nullptr;     /* NDUInt32, NULL between groups */
+        NDDataType_t type;          /* of the captures */
+        Frame last;                 /* the latest capture, without its image */
+        int frames = 0;
+        int calculated = 0;
+        int scans = 0;              /* captures with scan data */
+        int moments = 0;            /* captures with valid driver moments */
+        double scan_sums[std::size(scan_attributes)];
+        BeamMoments moment_sums;
+    } accumulation;
+
+    /* Pre-trigger ring of frames waiting for a burst, oldest first, and the
+     * post-trigger frames still to publish. Only used by the capture thread.
+     * The frames keep their NDArrays, so the ring holds frame pool buffers */
+    std::deque<Frame> burst_ring;
+    size_t burst_bytes = 0;         /* of the NDArrays in the ring */
+    int burst_post_remaining = 0;
+    int burst_post_frame = 0;
+
+    /* The BeamMoments fields averaged over accumulated frames */
+    static constexpr double BeamMoments::*moment_fields[] = {
+        &BeamMoments::background, &BeamMoments::total, &BeamMoments::centroid_x,
+        &BeamMoments::centroid_y, &BeamMoments::sigma2_x, &BeamMoments::sigma2_y,
+        &BeamMoments::sigma2_xy, &BeamMoments::width_x, &BeamMoments::width_y,
+        &BeamMoments::width_x_simple, &BeamMoments::width_y_simple,
+        &BeamMoments::ellipticity, &BeamMoments::azimuth,
+    };
+
+    /* Slow device operations, run one at a time off the port */
+    OperationRunner operations;
+    /* SDK status after the last ambient light correction, written by the
+     * operations thread */
+    ViUInt8 ambient_result = AMBIENT_LIGHT_CORRECTION_NEVER_RUN;
+
+    /* Commits the staged ROI once writes have stopped for a while */
+    struct RoiCommitTimer: epicsTimerNotify {
+        ADTLBC2 &driver;
+
+        RoiCommitTimer(ADTLBC2 &driver): driver(driver) {}
+        expireStatus expire(const epicsTime &) override
+        {
+            driver.lock();
+            driver.commitROI(driver.pasynUserSelf);
+            driver.unlock();
+            return expireStatus(noRestart);
+        }
+    } roi_timer_notify;
+    /* Not shared: applying the ROI waits for the device, which may be busy
+     * reading a frame, and would hold up other users of a shared queue */
+    epicsTimerQueueActive &timer_queue;
+    epicsTimer &roi_timer;
+
+    /* Settings that map directly onto SDK getters and setters, indexed by
+     * the enum below */
+    std::tuple<
+        Parameter<ViReal64, ViReal64, TLBC2_get_exposure_time,
+                  TLBC2_set_exposure_time, TLBC2_get_exposure_time_range>,
+        Parameter<ViReal64, ViReal64, TLBC2_get_gain, TLBC2_set_gain,
+                  TLBC2_get_gain_range>,
+        Parameter<ViReal64, ViReal64, TLBC2_get_temperature>,
+        Parameter<ViInt32, ViUInt8, TLBC2_get_ambient_light_correction_mode,
+                  TLBC2_set_ambient_light_correction_mode>,
+        Parameter<ViReal64, ViReal64, TLBC2_get_attenuation,
+                  TLBC2_set_attenuation>,
+        Parameter<ViInt32, ViBoolean, TLBC2_get_auto_exposure,
+                  TLBC2_set_auto_exposure>,
+        Parameter<ViReal64, ViReal64, TLBC2_get_auto_calculation_area_clip_level,
+                  TLBC2_set_auto_calculation_area_clip_level>,
+        Parameter<ViReal64, ViReal64, TLBC2_get_clip_level, TLBC2_set_clip_level>,
+        Parameter<ViReal64, ViReal64, TLBC2_get_wavelength, TLBC2_set_wavelength,
+                  TLBC2_get_wavelength_range>
+    > params {
+        "exposure_time",
+        "gain",
+        "temperature",
+        "ambient_light_correction_mode",
+        "attenuation",
+        "auto_exposure",
+        "auto_calculation_area_clip_level",
+        "clip_level",
+        "wavelength",
+    };
+
+    enum {
+        ParamAcquireTime,
+        ParamGain,
+        ParamTemperature,
+        ParamAmbientLightCorrection,
+        ParamAttenuation,
+        ParamAutoExposure,
+        ParamAutoCalcAreaClipLevel,
+        ParamClipLevel,
+        ParamWavelength,
+        NumParams
+    };
+
+    static_assert(std::tuple_size_v<decltype(params)> == NumParams);
 
+    /* asyn reason -> index into params, or -1. asyn numbers parameters
+     * from 0, so a small table covers all of them */
+    static constexpr int max_reasons = 512;
+    signed char param_index[max_reasons];
+
+    int BCAccumulateFrames;
+    int BCAccumulateMode;
+    int BCAccumulateProgress;
+    int BCAchievedFps;
     int BCAmbientLightCorrection;
     int BCAmbientLightCorrectionStatus;
     int BCAttenuation;
+    int BCAttributeSet;
     int BCAutoExposure;
     int BCAutoCalcAreaClipLevel;
+    int BCAutoRoi;
+    int BCAutoRoiChanges;
+    int BCAutoRoiFpsGain;
+    int BCAutoRoiMargin;
+    int BCAutoRoiMaxRate;
+    int BCAutoRoiTime;
+    int BCBackgroundCapture;
+    int BCBackgroundClear;
+    int BCBackgroundFile;
+    int BCBackgroundFrames;
+    int BCBackgroundLoad;
+    int BCBackgroundProgress;
+    int BCBackgroundReferences;
+    int BCBackgroundSave;
+    int BCBackgroundSubtract;
+    int BCBackgroundSubtracted;
     int BCBeamWidthX;
     int BCBeamWidthY;
+    int BCBurstCount;
+    int BCBurstHeld;
+    int BCBurstMemory;
+    int BCBurstMode;
+    int BCBurstPostFrames;
+    int BCBurstPreFrames;
+    int BCBurstTrigger;
+    int BCCalcDecimation;
+    int BCCalcFps;
+    int BCCalcMaxRate;
+    int BCCaptureStalls;
     int BCCentroidX;
     int BCCentroidY;
     int BCClipLevel;
+    int BCCodec;
+    int BCCodecRatio;
+    int BCCodecThroughput;
     int BCComputeAmbientLightCorrection;
+    int BCExposureControl;
+    int BCExposureConverged;
+    int BCExposureConvergenceFrames;
+    int BCExposureConvergenceTime;
+    int BCExposureLevel;
+    int BCExposurePercentile;
+    int BCExposureTarget;
+    int BCExposureTolerance;
+    int BCExposureUseAttenuation;
+    int BCFramePoolDroppedNewest;
+    int BCFramePoolDroppedOldest;
+    int BCFramePoolHighWater;
+    int BCFramePoolInUse;
+    int BCFramePoolPolicy;
+    int BCFramePoolSize;
+    int BCFramePoolStalls;
+    int BCInvalidScans;
+    int BCLatencyBuckets;
+    int BCLatencyHistogram[NumStages];
+    int BCLatencyMax[NumStages];
+    int BCLatencyP50[NumStages];
+    int BCLatencyP99[NumStages];
+    int BCLatencyReset;
+    int BCMomentsDiffCentroidX;
+    int BCMomentsDiffCentroidY;
+    int BCMomentsDiffWidthX;
+    int BCMomentsDiffWidthY;
+    int BCMomentsSource;
+    int BCPeriodAchieved;
+    int BCPeriodJitter;
+    int BCPeriodLatenessMax;
+    int BCPeriodMode;
+    int BCPeriodOverruns;
+    int BCPreviewBinning;
+    int BCPreviewDropped;
+    int BCPreviewEnable;
+    int BCPreviewMaxRate;
+    int BCPreviewMode;
+    int BCProfile[NumProfiles];
+    int BCProfileAmplitude[NumProfiles];
+    int BCProfileAngle;
+    int BCProfileBackground[NumProfiles];
+    int BCProfileCenter[NumProfiles];
+    int BCProfileEnable;
+    int BCProfileRating[NumProfiles];
+    int BCProfileRotate;
+    int BCProfileWidth[NumProfiles];
+    int BCPublishStalls;
+    int BCQueueDepth;
+    int BCQueueHighWater;
+    int BCRawMode;
+    int BCRoiApply;
+    int BCRoiApplyLatency;
+    int BCRoiCoalesceTime;
+    int BCRoiCommit;
+    int BCRoiPending;
+    int BCResults[NumResults];
+    int BCResultsCount;
+    int BCResultsFrame;
+    int BCResultsOnly;
+    int BCResultsOverruns;
+    int BCResultsPeriod;
     int BCSaturation;
+    int BCStability[num_stability_channels][NumStabilityStats];
+    int BCStabilityAdev[num_stability_channels];
+    int BCStabilityReset;
+    int BCStabilitySamples;
+    int BCStabilityTau;
+    int BCStabilityWindow;
+    int BCCacheHits;
+    int BCCacheMaxAge;
+    int BCCacheMisses;
+    int BCSdkCalls;
+    int BCSchedWait[DeviceScheduler::NumPriorities];
+    int BCSchedWaitMax[DeviceScheduler::NumPriorities];
+    int BCSchedWaitReset;
     int BCWavelength;
 
-    template<typename T>
-    asynStatus writeParam(asynUser *user, Parameter<T> &param, T value, T &readback) {
-        asynStatus status = asynSuccess;
+    template<size_t I>
+    void bindParam(int reason)
+    {
+        if (reason >= max_reasons)
+            throw std::runtime_error("too many asyn parameters");
 
-        try {
-            handle_tlbc2_err(param.set(instr, value), "set_" + param.name);
-        } catch (const std::runtime_error &err) {
-            // when failing to set, we still need to readback, so just
-            // report this and keep going
-            asynPrint(user, ASYN_TRACE_ERROR, "%s\n", err.what());
-            setStringParam(ADStatusMessage, err.what());
+        std::get<I>(params).reason = reason;
+        param_index[reason] = I;
+    }
 
-            status = asynError;
+    template<typename F, size_t... I>
+    bool visitParam(int index, F &f, std::index_sequence<I...>)
+    {
+        return ((index == (int)I && (f(std::get<I>(params)), true)) || ...);
+    }
+
+    /* Calls f with the parameter bound to reason. Returns false if there is
+     * none */
+    template<typename F>
+    bool visitParam(int reason, F &&f)
+    {
+        if (reason < 0 || reason >= max_reasons || param_index[reason] < 0)
+            return false;
+
+        return visitParam(param_index[reason], f,
+                          std::make_index_sequence<NumParams>());
+    }
+
+    template<typename F>
+    void forEachParam(F &&f)
+    {
+        std::apply([&](auto &... param) { (f(param), ...); }, params);
+    }
+
+    template<typename P, typename T = typename P::value_type>
+    asynStatus writeParam(asynUser *user, P &param, T value, T &readback) {
+        std::string error;
+        T min, max;
+        bool range_fetched = false;
+        bool fetch_range = false;
+
+        if constexpr (P::has_range) {
+            fetch_range = !param.cached_range(min, max);
+            countCacheLookup(!fetch_range);
         }
 
-        handle_tlbc2_err(param.get(instr, readback), "get_" + param.name);
+        {
+            PortUnlocker unlocker(*this);
 
-        return status;
+            device.execute(DeviceScheduler::Control, [&](ViSession vi) {
+                try {
+                    if constexpr (P::has_range) {
+                        if (fetch_range) {
+                            handle_tlbc2_err(vi, param.get_range(vi, min, max),
+                                             "get range of", param.name);
+                            range_fetched = true;
+                        }
+
+                        P::check_range(value, min, max);
+                    }
+
+                    handle_tlbc2_err(vi, param.set(vi, value), "set", param.name);
+                } catch (const std::runtime_error &err) {
+                    // when failing to set, we still need to readback, so just
+                    // report this and keep going
+                    error = err.what();
+                }
+
+                handle_tlbc2_err(vi, param.get(vi, readback), "get", param.name);
+            });
+        }
+
+        if (range_fetched)
+            param.store_range(min, max);
+
+        /* a write can change other settings too, e.g. enabling auto
+         * exposure changes the exposure time */
+        invalidateReadbacks();
+        param.store(readback);
+
+        if (!error.empty()) {
+            asynPrint(user, ASYN_TRACE_ERROR, "%s\n", error.c_str());
+            setStringParam(ADStatusMessage, error.c_str());
+
+            return asynError;
+        }
+
+        return asynSuccess;
+    }
+
+    template<typename P, typename T = typename P::value_type>
+    T readDeviceParam(P &param, DeviceScheduler::Priority priority) {
+        return device.execute(priority, [&](ViSession vi) {
+            T readback;
+
+            handle_tlbc2_err(vi, param.get(vi, readback), "get", param.name);
+            return readback;
+        });
+    }
+
+    void invalidateReadbacks()
+    {
+        forEachParam([](auto &param) { param.invalidate(); });
+    }
+
+    void invalidateRanges()
+    {
+        forEachParam([](auto &param) { param.invalidate_range(); });
+    }
+
+    void countCacheLookup(bool hit)
+    {
+        if (hit)
+            cache_hits++;
+        else
+            cache_misses++;
+        updateCacheCounters();
     }
 
-    template<typename T>
-    void readbackParam(const int asyn_param, Parameter<T> &param) {
-        T readback;
+    void updateCacheCounters()
+    {
+        setIntegerParam(BCCacheHits, cache_hits);
+        setIntegerParam(BCCacheMisses, cache_misses);
+        setIntegerParam(BCSdkCalls, sdk_calls);
+    }
+
+    template<typename P>
+    void readbackParam(P &param) {
+        auto readback = readDeviceParam(param, DeviceScheduler::Housekeeping);
+
+        param.store(readback);
 
-        handle_tlbc2_err(param.get(instr, readback), "get_" + param.name);
-        if constexpr (std::is_same_v<T, ViInt32>) {
-            setIntegerParam(asyn_param, readback);
+        if constexpr (std::is_same_v<typename P::value_type, ViInt32>) {
+            setIntegerParam(param.reason, readback);
         } else {
-            setDoubleParam(asyn_param, readback);
+            setDoubleParam(param.reason, readback);
         }
     }
 
@@ -150,16 +914,26 @@ class epicsShareClass ADTLBC2: ADDriver, epicsThreadRunable {
     {
         const int function = pasynUser->reason;
 
-        auto item = params.find(function);
+        bool handled = false;
+        asynStatus status;
 
-        if (item != params.end()) {
-            auto param = std::get<Parameter<ViInt32>>(item->second);
-            ViInt32 readback;
+        visitParam(function, [&](auto &param) {
+            using P = std::decay_t<decltype(param)>;
 
-            asynStatus status =
-                writeParam<ViInt32>(pasynUser, param, value, readback);
+            if constexpr (P::settable && std::is_same_v<typename P::value_type, ViInt32>) {
+                ViInt32 readback;
+
+                status = writeParam(pasynUser, param, value, readback);
+                setIntegerParam(function, readback);
+                handled = true;
+            }
+        });
+
+        if (handled) {
+            /* the SDK's auto exposure and the driver's would fight */
+            if (function == BCAutoExposure && value)
+                setIntegerParam(BCExposureControl, 0);
 
-            setIntegerParam(function, readback);
             callParamCallbacks();
             return status;
         } else if (function == ADAcquire) {
@@ -190,242 +964,2114 @@ class epicsShareClass ADTLBC2: ADDriver, epicsThreadRunable {
         } else if (function == ADSizeX || function == ADSizeY ||
                    function == ADMinX || function == ADMinY) {
             return writeROI(pasynUser, value);
+        } else if (function == BCRoiApply && value) {
+            return commitROI(pasynUser);
         } else if (function == BCComputeAmbientLightCorrection && value == 1) {
             return runAmbientLightCorrection(pasynUser);
+        } else if (function == BCComputeAmbientLightCorrection && operations.busy()) {
+            /* the driver clears it when the computation is done */
+            return asynError;
+        } else if (function == BCSchedWaitReset && value) {
+            device.reset_stats();
+        } else if (function == BCAttributeSet) {
+            if (value < 0 || value >= NumAttributeSets)
+                return asynError;
+
+            selectAttributes(value);
+        } else if (function == BCLatencyReset && value) {
+            resetLatency();
+            updateLatency(true);
+        } else if (function == BCStabilityWindow) {
+            if (value < 0 || value > max_stability_window)
+                return asynError;
+
+            resetStability(value);
+        } else if (function == BCStabilityReset && value) {
+            int window;
+            getIntegerParam(BCStabilityWindow, &window);
+            resetStability(window);
+        } else if (function == BCPreviewBinning) {
+            if (value != 1 && value != 2 && value != 4 && value != 8)
+                return asynError;
+        } else if (function == BCCodec) {
+            if (value < CodecNone || value > CodecBSLZ4)
+                return asynError;
+
+            if (value != CodecNone && !bslz4_available) {
+                setStringParam(ADStatusMessage, "built without bitshuffle (HAVE_BITSHUFFLE)");
+                callParamCallbacks();
+                return asynError;
+            }
+        } else if (function == BCBackgroundFrames) {
+            if (value < 1 || value > max_background_frames)
+                return asynError;
+        } else if (function == BCAccumulateFrames) {
+            if (value < 1 || value > max_accumulate_frames)
+                return asynError;
+        } else if (function == BCAccumulateMode) {
+            if (value < AccumulateSum || value > AccumulateMean)
+                return asynError;
+        } else if (function == BCBurstPreFrames || function == BCBurstPostFrames) {
+            if (value < 0)
+                return asynError;
+        } else if (function == BCBurstTrigger && value) {
+            int burst_mode, acquiring;
+            getIntegerParam(BCBurstMode, &burst_mode);
+            getIntegerParam(ADAcquire, &acquiring);
+            if (!burst_mode || !acquiring)
+                return asynError;
+        } else if (function == BCBackgroundClear && value) {
+            dark_frames = std::make_shared<DarkFrames>();
+            setIntegerParam(BCBackgroundReferences, 0);
+        } else if (function == BCBackgroundSave && value) {
+            return saveDarkFrames(pasynUser) ? asynSuccess : asynError;
+        } else if (function == BCBackgroundLoad && value) {
+            return loadDarkFrames(pasynUser) ? asynSuccess : asynError;
+        } else if (function == BCFramePoolSize) {
+            if (value < 1)
+                return asynError;
+        } else if (function == BCFramePoolPolicy) {
+            if (value < PoolBlock || value > PoolDropOldest)
+                return asynError;
+        } else if (function == BCExposureControl && value) {
+            int auto_exposure;
+            getIntegerParam(BCAutoExposure, &auto_exposure);
+
+            if (auto_exposure) {
+                ViInt32 readback;
+
+                writeParam(pasynUser, std::get<ParamAutoExposure>(params), 0, readback);
+                setIntegerParam(BCAutoExposure, readback);
+            }
+            setIntegerParam(BCExposureConverged, 0);
+        }
+
+        return ADDriver::writeInt32(pasynUser, value);
+    }
+
+    /* Starts computing the ambient light correction. It runs on the
+     * operations thread, and the status reads Computing until it is done */
+    asynStatus runAmbientLightCorrection(asynUser *user)
+    {
+        const bool started = startOperation("ambient light correction",
+            [this](ViSession vi) {
+                ambient_result = AMBIENT_LIGHT_CORRECTION_FAILED;
+                handle_tlbc2_err(vi, TLBC2_run_ambient_light_correction(vi),
+                                 "run_ambient_light_correction");
+                handle_tlbc2_err(vi,
+                    TLBC2_get_ambient_light_correction_status(vi, &ambient_result),
+                    "get_ambient_light_correction_status");
+            },
+            [this](bool) {
+                invalidateReadbacks();
+                setIntegerParam(BCComputeAmbientLightCorrection, 0);
+                setIntegerParam(BCAmbientLightCorrectionStatus, ambientStatus(ambient_result));
+            });
+
+        if (!started) {
+            asynPrint(user, ASYN_TRACE_ERROR, "ADTLBC2: another device operation is running\n");
+            return asynError;
+        }
+
+        setIntegerParam(BCComputeAmbientLightCorrection, 1);
+        setIntegerParam(BCAmbientLightCorrectionStatus, AmbientComputing);
+        callParamCallbacks();
+
+        return asynSuccess;
+    }
+
+    static int ambientStatus(ViUInt8 status)
+    {
+        switch (status) {
+        case AMBIENT_LIGHT_CORRECTION_AVAILABLE: return AmbientComputed;
+        case AMBIENT_LIGHT_CORRECTION_NEVER_RUN: return AmbientNeverRun;
+        default: return AmbientFailed;
+        }
+    }
+
+    /* Runs op(vi) as a client command on the operations thread, so slow
+     * device operations hold up neither the port nor the acquisition
+     * thread beyond the device time they take. done(ok) is called with the
+     * port lock held afterwards; errors have been reported by then. Returns
+     * false if another operation is running */
+    template<typename Op, typename Done>
+    bool startOperation(const char *name, Op op, Done done)
+    {
+        return operations.start([this, name, op, done]() {
+            std::string error;
+
+            try {
+                device.execute(DeviceScheduler::Control, op);
+            } catch (const std::runtime_error &err) {
+                error = err.what();
+            }
+
+            lock();
+            if (!error.empty()) {
+                asynPrint(pasynUserSelf, ASYN_TRACE_ERROR, "ADTLBC2: %s: %s\n",
+                          name, error.c_str());
+                setStringParam(ADStatusMessage, error.c_str());
+            }
+            done(error.empty());
+            callParamCallbacks();
+            unlock();
+        });
+    }
+
+    /* Stages a write to one of the ROI fields. The staged ROI is applied as
+     * a whole, after ROI_COALESCE_TIME without further writes or on
+     * ROI_APPLY */
+    asynStatus writeROI(asynUser *user, int value)
+    {
+        const int param = user->reason;
+
+        if (!roi_staged_pending) {
+            getIntegerParam(ADMinX, &roi_staged.minx);
+            getIntegerParam(ADMinY, &roi_staged.miny);
+            getIntegerParam(ADSizeX, &roi_staged.sizex);
+            getIntegerParam(ADSizeY, &roi_staged.sizey);
+            roi_staged.time = epicsMonotonicGet();
+            roi_staged_pending = true;
+        }
+
+        if (param == ADSizeX)
+            roi_staged.sizex = value;
+        else if (param == ADSizeY)
+            roi_staged.sizey = value;
+        else if (param == ADMinX)
+            roi_staged.minx = value;
+        else if (param == ADMinY)
+            roi_staged.miny = value;
+
+        int mode;
+        double window;
+        getIntegerParam(BCRoiCommit, &mode);
+        getDoubleParam(BCRoiCoalesceTime, &window);
+
+        setIntegerParam(BCRoiPending, 1);
+        callParamCallbacks();
+
+        if (mode == RoiCommitCoalesce) {
+            if (window <= 0)
+                return commitROI(user);
+
+            /* restarting pushes the commit back until writes stop */
+            roi_timer.start(roi_timer_notify, window);
+        }
+
+        return asynSuccess;
+    }
+
+    /* Validates the staged ROI and applies it, or leaves it to the capture
+     * thread to apply between two frames */
+    asynStatus commitROI(asynUser *user)
+    {
+        if (!roi_staged_pending)
+            return asynSuccess;
+
+        const RoiRequest request = roi_staged;
+        roi_staged_pending = false;
+        setIntegerParam(BCRoiPending, 0);
+
+        int maxSizeX, maxSizeY;
+        getIntegerParam(ADMaxSizeX, &maxSizeX);
+        getIntegerParam(ADMaxSizeY, &maxSizeY);
+
+        if (request.minx < 0 || request.miny < 0 ||
+            request.sizex < 1 || request.sizey < 1 ||
+            request.minx + request.sizex > maxSizeX ||
+            request.miny + request.sizey > maxSizeY) {
+            const std::string error = "ROI " + std::to_string(request.sizex) + "x" +
+                std::to_string(request.sizey) + " at " + std::to_string(request.minx) +
+                "," + std::to_string(request.miny) + " is outside the sensor";
+
+            asynPrint(user, ASYN_TRACE_ERROR, "%s\n", error.c_str());
+            setStringParam(ADStatusMessage, error.c_str());
+            callParamCallbacks();
+
+            return asynError;
+        }
+
+        if (capturing) {
+            roi_deferred = request;
+            roi_deferred_pending = true;
+            callParamCallbacks();
+
+            return asynSuccess;
+        }
+
+        return applyROI(user, request);
+    }
+
+    asynStatus applyROI(asynUser *user, const RoiRequest &request)
+    {
+        asynStatus status = asynSuccess;
+        int maxSizeX, maxSizeY;
+
+        getIntegerParam(ADMaxSizeX, &maxSizeX);
+        getIntegerParam(ADMaxSizeY, &maxSizeY);
+
+        ViUInt16 left, top, width, height;
+        std::string set_error, get_error;
+
+        {
+            PortUnlocker unlocker(*this);
+
+            /* a single command, so that no frame is captured halfway through */
+            device.execute(DeviceScheduler::Control, [&](ViSession vi) {
+                try {
+                    set_roi(vi, request.minx, request.miny, request.sizex,
+                            request.sizey, maxSizeX, maxSizeY);
+                } catch (const std::runtime_error &err) {
+                    set_error = err.what();
+                }
+
+                try {
+                    get_roi(vi, left, top, width, height);
+                } catch (const std::runtime_error &err) {
+                    get_error = err.what();
+                }
+            });
+        }
+
+        /* limits such as the exposure time range can depend on the ROI */
+        invalidateReadbacks();
+        invalidateRanges();
+
+        if (!set_error.empty()) {
+            asynPrint(user, ASYN_TRACE_ERROR, "%s\n", set_error.c_str());
+            setStringParam(ADStatusMessage, set_error.c_str());
+
+            status = asynError;
+        }
+
+        if (!get_error.empty()) {
+            asynPrint(user, ASYN_TRACE_ERROR, "%s\n", get_error.c_str());
+            setStringParam(ADStatusMessage, get_error.c_str());
+            callParamCallbacks();
+
+            return asynError;
+        }
+
+        setIntegerParam(ADMinX, left);
+        setIntegerParam(ADMinY, top);
+        setIntegerParam(ADSizeX, width);
+        setIntegerParam(ADSizeY, height);
+        setDoubleParam(BCRoiApplyLatency, (epicsMonotonicGet() - request.time) * 1e-6);
+
+        callParamCallbacks();
+
+        return status;
+    }
+
+    /* Applies an ROI that was left for a frame boundary which did not come
+     * because the acquisition ended */
+    void flushDeferredROI()
+    {
+        if (!roi_deferred_pending)
+            return;
+
+        roi_deferred_pending = false;
+        applyROI(pasynUserSelf, roi_deferred);
+    }
+
+    /* Sets the hardware ROI from within a device command */
+    void set_roi(ViSession vi, int minx, int miny, int sizex, int sizey,
+                 int maxSizeX, int maxSizeY)
+    {
+        ViBoolean automatic;
+        ViUInt8 form;
+
+        handle_tlbc2_err(vi,
+            TLBC2_get_calculation_area_mode(vi, &automatic, &form),
+            "get_calculation_area_mode");
+
+        handle_tlbc2_err(vi, TLBC2_set_calculation_area_mode(vi, VI_ON, 0),
+                         "set_calculation_area_mode");
+
+        /* resetting the user calculation area is necessary to avoid
+         * triggering a segfault in the library code */
+        handle_tlbc2_err(vi,
+            TLBC2_set_user_calculation_area(vi, 0, 0, maxSizeX, maxSizeY, 0),
+            "set_user_calculation_area");
+
+        handle_tlbc2_err(vi, TLBC2_set_roi(vi, (ViUInt16)minx,
+                                           (ViUInt16)miny, (ViUInt16)sizex,
+                                           (ViUInt16)sizey),
+                         "set_roi");
+
+        handle_tlbc2_err(vi,
+            TLBC2_set_calculation_area_mode(vi, automatic, form),
+            "set_calculation_area_mode");
+    }
+
+    /* Reads back the hardware ROI from within a device command */
+    void get_roi(ViSession vi, ViUInt16 &left, ViUInt16 &top, ViUInt16 &width,
+                 ViUInt16 &height)
+    {
+        handle_tlbc2_err(vi, TLBC2_get_roi(vi, &left, &top, &width, &height),
+                         "get_roi");
+
+        roi_left = left;
+        roi_top = top;
+        roi_width = width;
+        roi_height = height;
+    }
+
+    asynStatus writeFloat64(asynUser *pasynUser, epicsFloat64 value) override
+    {
+        const int function = pasynUser->reason;
+        ViReal64 readback;
+
+        try {
+            bool handled = false;
+            asynStatus status;
+
+            visitParam(function, [&](auto &param) {
+                using P = std::decay_t<decltype(param)>;
+
+                if constexpr (P::settable && std::is_same_v<typename P::value_type, ViReal64>) {
+                    status = writeParam(pasynUser, param, value, readback);
+                    setDoubleParam(function, readback);
+                    handled = true;
+                }
+            });
+
+            if (handled) {
+                if (function == ADAcquireTime) {
+                    setIntegerParam(BCAutoExposure, 0);
+                    setIntegerParam(BCExposureControl, 0);
+                }
+
+                callParamCallbacks();
+                return status;
+            }
+
+            return ADDriver::writeFloat64(pasynUser, value);
+        } catch (const std::runtime_error &err) {
+            asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s\n", err.what());
+            setStringParam(ADStatusMessage, err.what());
+            callParamCallbacks();
+
+            return asynError;
+        }
+    }
+
+    asynStatus writeOctet(asynUser *pasynUser, const char *value, size_t nChars,
+                          size_t *nActual) override
+    {
+        const int function = pasynUser->reason;
+
+        if (function == BCBackgroundFile) {
+            std::string path(value, nChars);
+            path = path.substr(0, path.find('\0'));
+
+            setStringParam(BCBackgroundFile, path);
+            *nActual = nChars;
+
+            /* restores the dark frames when autosave restores the path at
+             * IOC start */
+            if (!path.empty() && !dark_frames->size())
+                loadDarkFrames(pasynUser);
+
+            callParamCallbacks();
+            return asynSuccess;
+        }
+
+        return ADDriver::writeOctet(pasynUser, value, nChars, nActual);
+    }
+
+    /* Writes the dark frames to BACKGROUND_FILE, if set. Called with the
+     * port lock held */
+    bool saveDarkFrames(asynUser *user)
+    {
+        std::string path;
+        getStringParam(BCBackgroundFile, path);
+        if (path.empty())
+            return true;
+
+        const std::shared_ptr<const DarkFrames> frames = dark_frames;
+        std::string error;
+
+        {
+            PortUnlocker unlocker(*this);
+            try {
+                frames->save(path.c_str());
+            } catch (const std::runtime_error &err) {
+                error = err.what();
+            }
+        }
+
+        if (!error.empty()) {
+            asynPrint(user, ASYN_TRACE_ERROR, "ADTLBC2: %s\n", error.c_str());
+            setStringParam(ADStatusMessage, error.c_str());
+            callParamCallbacks();
+            return false;
+        }
+
+        return true;
+    }
+
+    /* Replaces the dark frames with those in BACKGROUND_FILE. Called with
+     * the port lock held */
+    bool loadDarkFrames(asynUser *user)
+    {
+        std::string path, error;
+        getStringParam(BCBackgroundFile, path);
+
+        auto frames = std::make_shared<DarkFrames>();
+        {
+            PortUnlocker unlocker(*this);
+            try {
+                frames->load(path.c_str());
+            } catch (const std::runtime_error &err) {
+                error = err.what();
+            }
+        }
+
+        if (!error.empty()) {
+            asynPrint(user, ASYN_TRACE_ERROR, "ADTLBC2: %s\n", error.c_str());
+            setStringParam(ADStatusMessage, error.c_str());
+            callParamCallbacks();
+            return false;
+        }
+
+        dark_frames = frames;
+        setIntegerParam(BCBackgroundReferences, frames->size());
+        callParamCallbacks();
+        return true;
+    }
+
+    /* Adds a frame to the dark frame being captured, starting afresh when
+     * the ROI or settings differ from the frames so far. Returns the dark
+     * frame once frames frames were added. Called by the capture thread */
+    std::shared_ptr<const DarkFrame> captureDark(const NDArray *image, const DarkFrame &settings,
+                                                 int frames)
+    {
+        DarkFrame &dark = dark_capture.frame;
+        const size_t pixels = (size_t)settings.width * settings.height;
+
+        if (!dark_capture.count || dark.width != settings.width ||
+            dark.height != settings.height ||
+            !dark.applies(settings.left, settings.top, settings.width, settings.height,
+                          settings.bpp, settings.exposure, settings.gain)) {
+            dark = settings;
+            dark_capture.sum.assign(pixels, 0);
+            dark_capture.count = 0;
+        }
+
+        if (settings.bpp == 2)
+            accumulate_frame(workers, (const epicsUInt16 *)image->pData, pixels, dark_capture.sum.data());
+        else
+            accumulate_frame(workers, (const epicsUInt8 *)image->pData, pixels, dark_capture.sum.data());
+
+        if (++dark_capture.count < frames)
+            return nullptr;
+
+        auto done = std::make_shared<DarkFrame>(settings);
+        average_dark(dark_capture.sum.data(), pixels, dark_capture.count, *done);
+        dark_capture.count = 0;
+        return done;
+    }
+
+    /* Adds a capture to the frame being accumulated and releases it, so the
+     * frame pool does not run out however many frames are accumulated.
+     * Returns true with frame replaced by the accumulated frame once frames
+     * captures were added, or when the capture's size or pixel format
+     * differs from the ones before, which then start the next frame. Called
+     * by the capture thread */
+    bool accumulateFrame(Frame &frame, int frames, int mode)
+    {
+        Accumulation &acc = accumulation;
+        NDArray *image = frame.image;
+        const size_t pixels = image->dims[0].size * image->dims[1].size;
+        Frame done;
+        bool finished = false;
+
+        if (acc.sum && (acc.sum->dims[0].size != image->dims[0].size ||
+                        acc.sum->dims[1].size != image->dims[1].size ||
+                        acc.type != image->dataType)) {
+            try {
+                finished = finishAccumulation(done, mode);
+            } catch (const std::runtime_error &) {
+                image->release();
+                throw;
+            }
+        }
+
+        const epicsUInt64 t = epicsMonotonicGet();
+
+        if (!acc.sum) {
+            size_t dims[] = {image->dims[0].size, image->dims[1].size};
+            acc.sum = this->pNDArrayPool->alloc(2, dims, NDUInt32, 0, NULL);
+            if (!acc.sum) {
+                image->release();
+                if (finished)
+                    done.image->release();
+                throw std::runtime_error("failed to allocate accumulated NDArray");
+            }
+
+            acc.type = image->dataType;
+            acc.frames = acc.calculated = acc.scans = acc.moments = 0;
+            std::fill(std::begin(acc.scan_sums), std::end(acc.scan_sums), 0.);
+            acc.moment_sums = {};
+
+            if (image->dataType == NDUInt16)
+                start_sum(workers, (const epicsUInt16 *)image->pData, pixels,
+                          (epicsUInt32 *)acc.sum->pData);
+            else
+                start_sum(workers, (const epicsUInt8 *)image->pData, pixels,
+                          (epicsUInt32 *)acc.sum->pData);
+        } else {
+            if (image->dataType == NDUInt16)
+                accumulate_frame(workers, (const epicsUInt16 *)image->pData, pixels,
+                                 (epicsUInt32 *)acc.sum->pData);
+            else
+                accumulate_frame(workers, (const epicsUInt8 *)image->pData, pixels,
+                                 (epicsUInt32 *)acc.sum->pData);
+        }
+
+        /* keep an exposure time read back by an earlier capture */
+        const ViReal64 exposure_time = acc.frames ? acc.last.exposure_time : -1;
+
+        image->release();
+        acc.last = frame;
+        acc.last.image = nullptr;
+        if (frame.exposure_time < 0)
+            acc.last.exposure_time = exposure_time;
+        acc.frames++;
+
+        if (frame.calculated) {
+            acc.calculated++;
+
+            if (frame.moments_source != MomentsDriver) {
+                for (size_t i = 0; i < std::size(scan_attributes); i++)
+                    acc.scan_sums[i] += scanField(frame.scan_data, scan_attributes[i]);
+                acc.scans++;
+            }
+
+            if (frame.moments_source != MomentsSDK && frame.moments.valid) {
+                for (auto field : moment_fields)
+                    acc.moment_sums.*field += frame.moments.*field;
+                acc.moments++;
+            }
+        }
+        lap(StageAccumulate, t);
+
+        if (!finished && acc.frames >= frames)
+            finished = finishAccumulation(done, mode);
+
+        if (finished)
+            frame = done;
+        return finished;
+    }
+
+    /* Turns the captures accumulated so far into one frame: their sum as
+     * NDUInt32, or their rounded mean with the captures' data type. The scan
+     * data and moments are the means over the captures that have them.
+     * Returns false if nothing was accumulated */
+    bool finishAccumulation(Frame &frame, int mode)
+    {
+        Accumulation &acc = accumulation;
+        if (!acc.sum)
+            return false;
+
+        const epicsUInt64 t = epicsMonotonicGet();
+
+        frame = acc.last;
+        frame.accumulated = acc.frames;
+        frame.calculated = acc.calculated > 0;
+
+        if (acc.scans) {
+            for (size_t i = 0; i < std::size(scan_attributes); i++)
+                setScanField(frame.scan_data, scan_attributes[i],
+                             acc.scan_sums[i] / acc.scans);
+            frame.scan_data.isValid = VI_TRUE;
+        }
+
+        if (acc.moments) {
+            for (auto field : moment_fields)
+                frame.moments.*field = acc.moment_sums.*field / acc.moments;
+            frame.moments.valid = true;
+        }
+
+        const size_t pixels = acc.sum->dims[0].size * acc.sum->dims[1].size;
+        const epicsUInt32 *sum = (const epicsUInt32 *)acc.sum->pData;
+
+        if (mode == AccumulateSum) {
+            frame.image = acc.sum;
+        } else {
+            size_t dims[] = {acc.sum->dims[0].size, acc.sum->dims[1].size};
+            frame.image = this->pNDArrayPool->alloc(2, dims, acc.type, 0, NULL);
+            if (!frame.image) {
+                discardAccumulation();
+                throw std::runtime_error("failed to allocate accumulated NDArray");
+            }
+
+            if (acc.type == NDUInt16)
+                average_frame(workers, sum, pixels, acc.frames, (epicsUInt16 *)frame.image->pData);
+            else
+                average_frame(workers, sum, pixels, acc.frames, (epicsUInt8 *)frame.image->pData);
+            acc.sum->release();
+        }
+
+        acc.sum = nullptr;
+        acc.frames = 0;
+        lap(StageAccumulate, t);
+        return true;
+    }
+
+    /* Drops the captures accumulated so far */
+    void discardAccumulation()
+    {
+        Accumulation &acc = accumulation;
+        if (!acc.sum)
+            return;
+
+        acc.sum->release();
+        acc.sum = nullptr;
+        acc.frames = 0;
+    }
+
+    /* Keeps a frame in the pre-trigger ring, dropping the oldest beyond
+     * BURST_PRE_FRAMES, until BURST_TRIGGER is written. The ring is then
+     * published oldest first, followed by BURST_POST_FRAMES frames, and
+     * BURST_TRIGGER goes back to 0. Returns true if publish said the image
+     * mode has enough frames. Called by the capture thread */
+    template<typename Publish>
+    bool burstFrame(Frame &frame, Publish &publish)
+    {
+        int trigger, pre_frames, post_frames;
+        getIntegerParam(BCBurstTrigger, &trigger);
+        getIntegerParam(BCBurstPreFrames, &pre_frames);
+        getIntegerParam(BCBurstPostFrames, &post_frames);
+        bool complete = false;
+
+        if (trigger && !burst_post_remaining) {
+            int position = -(int)burst_ring.size();
+
+            while (!burst_ring.empty() && !complete) {
+                Frame pre = burst_ring.front();
+                burst_ring.pop_front();
+                burst_bytes -= pre.image->dataSize;
+
+                pre.burst = true;
+                pre.burst_frame = position++;
+                complete = publish(pre);
+            }
+
+            burst_post_remaining = post_frames;
+            burst_post_frame = 0;
+            if (!burst_post_remaining)
+                finishBurst();
+        }
+
+        if (complete) {
+            frame.image->release();
+        } else if (burst_post_remaining) {
+            frame.burst = true;
+            frame.burst_frame = burst_post_frame++;
+            complete = publish(frame);
+
+            if (!--burst_post_remaining)
+                finishBurst();
+        } else {
+            /* the frame may wait a long time before it is published */
+            updateTimeStamps(frame.image);
+            burst_ring.push_back(frame);
+            burst_bytes += frame.image->dataSize;
+
+            while ((int)burst_ring.size() > pre_frames)
+                dropBurstFrame();
+        }
+
+        updateBurst();
+        callParamCallbacks();
+        return complete;
+    }
+
+    void finishBurst()
+    {
+        setIntegerParam(BCBurstTrigger, 0);
+        incrementParam(BCBurstCount);
+    }
+
+    void dropBurstFrame()
+    {
+        burst_bytes -= burst_ring.front().image->dataSize;
+        burst_ring.front().image->release();
+        burst_ring.pop_front();
+    }
+
+    /* Drops the pre-trigger ring and cancels a burst at the end of an
+     * acquisition */
+    void discardBurst()
+    {
+        while (!burst_ring.empty())
+            dropBurstFrame();
+        burst_post_remaining = 0;
+
+        setIntegerParam(BCBurstTrigger, 0);
+        updateBurst();
+    }
+
+    void updateBurst()
+    {
+        setIntegerParam(BCBurstHeld, burst_ring.size());
+        setDoubleParam(BCBurstMemory, burst_bytes / 1e6);
+    }
+
+    static double scanField(const TLBC1_Calculations &data, const ScanAttribute &attr)
+    {
+        const char *field = (const char *)&data + attr.offset;
+
+        switch (attr.type) {
+        case NDAttrFloat32:
+            return *(const ViReal32 *)field;
+        case NDAttrUInt16:
+            return *(const ViUInt16 *)field;
+        default:
+            return *(const ViReal64 *)field;
+        }
+    }
+
+    static void setScanField(TLBC1_Calculations &data, const ScanAttribute &attr, double value)
+    {
+        char *field = (char *)&data + attr.offset;
+
+        switch (attr.type) {
+        case NDAttrFloat32:
+            *(ViReal32 *)field = (ViReal32)value;
+            break;
+        case NDAttrUInt16:
+            *(ViUInt16 *)field = (ViUInt16)std::lround(value);
+            break;
+        default:
+            *(ViReal64 *)field = value;
+            break;
+        }
+    }
+
+    asynStatus readFloat64(asynUser *pasynUser, epicsFloat64 *value)
+    {
+        const int function = pasynUser->reason;
+
+        asynStatus status = asynSuccess;
+
+        visitParam(function, [&](auto &param) {
+            using P = std::decay_t<decltype(param)>;
+
+            if constexpr (std::is_same_v<typename P::value_type, ViReal64>) {
+                ViReal64 readback;
+                double max_age;
+
+                getDoubleParam(BCCacheMaxAge, &max_age);
+
+                const bool hit = param.cached(readback, max_age);
+                countCacheLookup(hit);
+
+                if (!hit) {
+                    try {
+                        PortUnlocker unlocker(*this);
+                        readback = readDeviceParam(param, DeviceScheduler::Housekeeping);
+                    } catch (const std::runtime_error &err) {
+                        asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s\n", err.what());
+                        setStringParam(ADStatusMessage, err.what());
+                        callParamCallbacks();
+
+                        status = asynError;
+                        return;
+                    }
+
+                    param.store(readback);
+                    updateCacheCounters();
+                }
+
+                setDoubleParam(function, readback);
+                callParamCallbacks();
+            }
+        });
+
+        if (status != asynSuccess)
+            return status;
+
+        for (int p = 0; p < DeviceScheduler::NumPriorities; p++) {
+            if (function == BCSchedWait[p] || function == BCSchedWaitMax[p]) {
+                auto stats = device.stats((DeviceScheduler::Priority)p);
+
+                setDoubleParam(BCSchedWait[p], stats.mean_wait * 1e3);
+                setDoubleParam(BCSchedWaitMax[p], stats.max_wait * 1e3);
+                callParamCallbacks();
+            }
+        }
+
+        return ADDriver::readFloat64(pasynUser, value);
+    }
+
+    /* Moves frame_deadline to the start of the next frame and waits for it
+     * or for stop_acquire_event. Called with the port lock held, which is
+     * released while waiting. Returns true if stop_acquire_event was
+     * triggered */
+    bool wait_frame_deadline() {
+        double period;
+        int mode;
+        getDoubleParam(ADAcquirePeriod, &period);
+        getIntegerParam(BCPeriodMode, &mode);
+
+        /* periods that truncate to 0 ns mean as fast as possible too, and
+         * must not reach the division below */
+        const epicsUInt64 now = epicsMonotonicGet();
+        const epicsUInt64 period_ns = mode == PeriodFastest || !(period > 0) ? 0 : period * 1e9;
+        if (period_ns == 0) {
+            frame_deadline = now;
+        } else {
+            /* a frame that cannot start on time starts late, and whole
+             * periods are skipped so the following ones keep the phase */
+            frame_deadline += period_ns;
+            if (frame_deadline < now) {
+                setIntegerParam(BCPeriodOverruns, ++period_overruns);
+                frame_deadline += (now - frame_deadline) / period_ns * period_ns;
+            }
+        }
+
+        setIntegerParam(ADStatus, ADStatusWaiting);
+        callParamCallbacks();
+
+        /* Stop requests need the port lock, which they get while the frame
+         * is captured, so there is no need to sleep when the deadline has
+         * passed */
+        if (frame_deadline <= now)
+            return stop_acquire_event.tryWait();
+
+        unlock();
+        /* .wait() returns true if the event was triggered, false if it timed out */
+        epicsUInt64 t = epicsMonotonicGet();
+        bool stop_acquisition = stop_acquire_event.wait((frame_deadline - now) * 1e-9);
+        t = lap(StagePeriodWait, t);
+        lock();
+        lap(StageLockWait, t);
+        return stop_acquisition;
+    }
+
+    /* Records the start of a frame in the achieved period, jitter and
+     * lateness statistics */
+    void startFrame() {
+        const epicsUInt64 now = epicsMonotonicGet();
+
+        if (frame_start) {
+            const double interval = (now - frame_start) * 1e-9;
+            const double delta = interval - period_mean;
+
+            period_count++;
+            period_mean += delta / period_count;
+            period_m2 += delta * (interval - period_mean);
+
+            setDoubleParam(BCPeriodAchieved, period_mean);
+            setDoubleParam(BCPeriodJitter, std::sqrt(period_m2 / period_count) * 1e3);
+        }
+
+        if (now > frame_deadline) {
+            period_lateness_max = std::max(period_lateness_max, (now - frame_deadline) * 1e-9);
+            setDoubleParam(BCPeriodLatenessMax, period_lateness_max * 1e3);
+        }
+
+        frame_start = now;
+    }
+
+    /* Captures one frame. Called with the port lock held, which is released
+     * while talking to the device so that the publisher keeps running */
+    Frame acquire_image() {
+        const epicsUInt64 capture_start = epicsMonotonicGet();
+
+        setIntegerParam(ADStatus, ADStatusAcquire);
+        callParamCallbacks();
+
+        Frame frame;
+        ViUInt16 width, height;
+        ViUInt8 bpp;
+
+        int auto_exposure;
+        double max_age;
+        getIntegerParam(BCAutoExposure, &auto_exposure);
+        getDoubleParam(BCCacheMaxAge, &max_age);
+
+        /* auto exposure changes the exposure time behind our back, but it
+         * only needs reading as often as the cache expires */
+        const epicsUInt64 now = epicsMonotonicGet();
+        const bool read_exposure = auto_exposure &&
+            (now - exposure_read_time) * 1e-9 >= max_age;
+        if (read_exposure)
+            exposure_read_time = now;
+
+        getIntegerParam(BCMomentsSource, &frame.moments_source);
+
+        int raw_mode, decimation;
+        double max_rate;
+        getIntegerParam(BCRawMode, &raw_mode);
+        getIntegerParam(BCCalcDecimation, &decimation);
+        getDoubleParam(BCCalcMaxRate, &max_rate);
+
+        frame.calculated = !raw_mode && calculation_due(decimation, max_rate, now);
+        frame.accumulated = 0;
+        frame.burst = false;
+
+        AutoRoiSettings auto_roi;
+        int auto_roi_enabled;
+        getIntegerParam(BCAutoRoi, &auto_roi_enabled);
+        getDoubleParam(BCAutoRoiMargin, &auto_roi.margin);
+        getDoubleParam(BCAutoRoiMaxRate, &auto_roi.max_rate);
+        getIntegerParam(ADMaxSizeX, &auto_roi.max_x);
+        getIntegerParam(ADMaxSizeY, &auto_roi.max_y);
+        auto_roi.enabled = auto_roi_enabled;
+
+        ExposureControl exposure = {};
+        int exposure_enabled, use_attenuation;
+        getIntegerParam(BCExposureControl, &exposure_enabled);
+        getIntegerParam(BCExposureUseAttenuation, &use_attenuation);
+        getDoubleParam(BCExposureTarget, &exposure.target);
+        getDoubleParam(BCExposurePercentile, &exposure.percentile);
+        getDoubleParam(BCExposureTolerance, &exposure.tolerance);
+        getDoubleParam(ADAcquireTime, &exposure.current.exposure);
+        getDoubleParam(BCAttenuation, &exposure.current.attenuation);
+        exposure.enabled = exposure_enabled;
+        exposure.limits.use_attenuation = use_attenuation;
+        exposure.limits.min_attenuation = min_attenuation;
+        exposure.limits.max_attenuation = max_attenuation;
+        exposure.range_cached = std::get<ParamAcquireTime>(params).cached_range(
+            exposure.limits.min_exposure, exposure.limits.max_exposure);
+
+        /* start afresh when exposure control is enabled again */
+        if (!exposure.enabled)
+            exposure_change_pending = exposure_converging = false;
+
+        bool exposure_applied = false, exposure_range_fetched = false;
+        bool exposure_converged = false;
+        double exposure_level = -1, exposure_converge_time = 0;
+        std::string exposure_error;
+
+        int background_subtract, background_capture, background_frames;
+        double gain;
+        getIntegerParam(BCBackgroundSubtract, &background_subtract);
+        getIntegerParam(BCBackgroundCapture, &background_capture);
+        getIntegerParam(BCBackgroundFrames, &background_frames);
+        getDoubleParam(ADGain, &gain);
+        const std::shared_ptr<const DarkFrames> darks = dark_frames;
+        std::shared_ptr<const DarkFrame> dark_done;
+        bool background_subtracted = false;
+
+        /* a capture cancelled by writing 0 starts over next time */
+        if (!background_capture)
+            dark_capture.count = 0;
+
+        /* an ROI committed during the acquisition is applied between frames */
+        const bool apply_roi = roi_deferred_pending;
+        const RoiRequest roi_request = roi_deferred;
+        roi_deferred_pending = false;
+
+        /* invalid scan data only stops the acquisition if every frame is
+         * supposed to have calculations, and the beam is not expected to
+         * leave the ROI */
+        const bool calculations_required = !raw_mode && decimation <= 1 &&
+            max_rate <= 0 && !auto_roi.enabled;
+        bool invalid_scan = false;
+
+        size_t dims[2], capacity;
+        ViUInt16 frame_left, frame_top;
+        bool roi_changed = false;
+        ViUInt16 new_roi[4];
+        std::string roi_error;
+
+        /* The ROI stays changed when reading the frame fails afterwards, so
+         * its readbacks are also published when an exception leaves */
+        auto publish_roi = [&]() {
+            if (roi_changed) {
+                setIntegerParam(ADMinX, new_roi[0]);
+                setIntegerParam(ADMinY, new_roi[1]);
+                setIntegerParam(ADSizeX, new_roi[2]);
+                setIntegerParam(ADSizeY, new_roi[3]);
+                setIntegerParam(BCAutoRoiChanges, auto_roi_changes);
+                setDoubleParam(BCAutoRoiTime, auto_roi_seconds * 1e3);
+            }
+
+            /* the ROI may have been set even if reading it back failed */
+            if (roi_changed || apply_roi) {
+                invalidateReadbacks();
+                invalidateRanges();
+            }
+
+            if (apply_roi)
+                setDoubleParam(BCRoiApplyLatency, (epicsMonotonicGet() - roi_request.time) * 1e-6);
+        };
+
+        struct RoiPublisher {
+            decltype(publish_roi) &publish;
+            bool done;
+            ~RoiPublisher() { if (!done) publish(); }
+        } roi_publisher{publish_roi, false};
+
+        {
+            PortUnlocker unlocker(*this);
+
+            device.execute(DeviceScheduler::Acquisition, [&](ViSession vi) {
+                /* between frames is the time to change the ROI */
+                if (apply_roi) {
+                    try {
+                        set_roi(vi, roi_request.minx, roi_request.miny, roi_request.sizex,
+                                roi_request.sizey, auto_roi.max_x, auto_roi.max_y);
+                    } catch (const std::runtime_error &err) {
+                        roi_error = err.what();
+                    }
+
+                    try {
+                        get_roi(vi, new_roi[0], new_roi[1], new_roi[2], new_roi[3]);
+                        roi_changed = true;
+                    } catch (const std::runtime_error &err) {
+                        roi_error = err.what();
+                    }
+                }
+
+                if (auto_roi.enabled) {
+                    try {
+                        roi_changed |= update_auto_roi(vi, auto_roi, new_roi);
+                    } catch (const std::runtime_error &err) {
+                        roi_error = err.what();
+                    }
+                }
+
+                if (exposure.enabled) {
+                    try {
+                        apply_exposure(vi, exposure, exposure_applied, exposure_range_fetched);
+                    } catch (const std::runtime_error &err) {
+                        exposure_error = err.what();
+                    }
+                }
+
+                frame_left = roi_left;
+                frame_top = roi_top;
+
+                /* Have the SDK write straight into the NDArray. TLBC2_get_image
+                 * takes no buffer size, so the buffer must hold the frame: any
+                 * ROI change was read back above, within this command, and the
+                 * scheduler keeps other SDK calls out until the image is read,
+                 * so the frame has the size of roi_width x roi_height. If the
+                 * read back failed the ROI is unknown, and the buffer holds the
+                 * whole sensor. The widest pixel format makes a wrong bpp guess
+                 * harmless */
+                dims[0] = roi_width;
+                dims[1] = roi_height;
+                capacity = roi_error.empty() ? dims[0] * dims[1] * max_bytes_per_pixel :
+                                               max_frame_size;
+
+                epicsUInt64 t = epicsMonotonicGet();
+                handle_tlbc2_err(vi, TLBC2_request_new_measurement(vi), "request_new_measurement");
+                t = lap(StageRequest, t);
+                if (!frame.calculated || frame.moments_source == MomentsDriver) {
+                    frame.scan_data = {};
+                } else {
+                    handle_tlbc2_err(vi, TLBC2_get_scan_data(vi, &frame.scan_data), "get_scan_data");
+                    t = lap(StageScanData, t);
+                    if (!frame.scan_data.isValid) {
+                        if (calculations_required)
+                            throw std::runtime_error("scan data is invalid");
+
+                        frame.calculated = false;
+                        invalid_scan = true;
+                    }
+                }
+
+                frame.exposure_time = -1;
+                if (read_exposure)
+                    readAcquireTime(vi, frame.exposure_time);
+
+                t = epicsMonotonicGet();
+                frame.image = frame_pool.allocFrame(2, dims, image_bpp == 2 ? NDUInt16 : NDUInt8, capacity);
+                if (!frame.image)
+                    throw std::runtime_error("failed to allocate NDArray");
+                t = lap(StageAlloc, t);
+
+                try {
+                    handle_tlbc2_err(vi, TLBC2_get_image(vi, (ViUInt8 *)frame.image->pData, &width, &height, &bpp), "get_image");
+                    lap(StageGetImage, t);
+                } catch (const std::runtime_error &) {
+                    frame.image->release();
+                    throw;
+                }
+            });
+
+            /* The prediction was wrong (e.g. the ROI changed behind our back), so
+             * move the data into an array whose dimensions and size match it */
+            if (width != dims[0] || height != dims[1] || bpp != image_bpp) {
+                const epicsUInt64 t = epicsMonotonicGet();
+                size_t frame_dims[] = {width, height};
+                auto pFrame = this->pNDArrayPool->alloc(2, frame_dims, bpp == 2 ? NDUInt16 : NDUInt8, 0, NULL);
+                if (!pFrame) {
+                    frame.image->release();
+                    throw std::runtime_error("failed to allocate NDArray");
+                }
+
+                memcpy(pFrame->pData, frame.image->pData, (size_t)width * height * bpp);
+                frame.image->release();
+                frame.image = pFrame;
+                image_bpp = bpp;
+                lap(StageCopy, t);
+            }
+
+            /* Dark frames are captured without subtraction. Subtracting
+             * before the moments and exposure levels leaves the beam only */
+            if (background_capture || background_subtract) {
+                const epicsUInt64 t = epicsMonotonicGet();
+                const DarkFrame settings = {frame_left, frame_top, width, height, bpp,
+                                            exposure.current.exposure, gain, 0, {}};
+
+                if (background_capture) {
+                    dark_done = captureDark(frame.image, settings, background_frames);
+                } else if (const DarkFrame *dark = darks->find(frame_left, frame_top, width, height,
+                                                               bpp, settings.exposure, gain)) {
+                    if (bpp == 2)
+                        subtract_dark(workers, (epicsUInt16 *)frame.image->pData,
+                                      frame_left, frame_top, width, height, *dark);
+                    else
+                        subtract_dark(workers, (epicsUInt8 *)frame.image->pData,
+                                      frame_left, frame_top, width, height, *dark);
+                    background_subtracted = true;
+                }
+                lap(StageBackground, t);
+            }
+
+            if (frame.calculated && frame.moments_source != MomentsSDK) {
+                const epicsUInt64 t = epicsMonotonicGet();
+
+                if (bpp == 2)
+                    frame.moments = compute_moments(workers, (epicsUInt16 *)frame.image->pData, width, height);
+                else
+                    frame.moments = compute_moments(workers, (epicsUInt8 *)frame.image->pData, width, height);
+                lap(StageMoments, t);
+            }
+
+            track_beam(frame, invalid_scan, frame_left, frame_top);
+
+            if (exposure.enabled && exposure.range_cached) {
+                const unsigned full_scale = bpp == 2 ? full_scale_16 : 255;
+                const FrameLevels levels = bpp == 2 ?
+                    measure_levels((epicsUInt16 *)frame.image->pData, width, height,
+                                   full_scale, exposure.percentile) :
+                    measure_levels((epicsUInt8 *)frame.image->pData, width, height,
+                                   full_scale, exposure.percentile);
+
+                exposure_level = levels.level;
+                exposure_converged = control_exposure(exposure, levels, capture_start,
+                                                      exposure_converge_time);
+            }
+        }
+
+        if (invalid_scan)
+            setIntegerParam(BCInvalidScans, ++invalid_scans);
+
+        if (background_capture)
+            setIntegerParam(BCBackgroundProgress, dark_capture.count);
+        setIntegerParam(BCBackgroundSubtracted, background_subtracted);
+        if (dark_done) {
+            auto frames = std::make_shared<DarkFrames>(*dark_frames);
+            frames->store(dark_done);
+            dark_frames = frames;
+
+            setIntegerParam(BCBackgroundCapture, 0);
+            setIntegerParam(BCBackgroundProgress, background_frames);
+            setIntegerParam(BCBackgroundReferences, frames->size());
+            saveDarkFrames(pasynUserSelf);
+        }
+
+        publish_roi();
+        roi_publisher.done = true;
+
+        if (exposure_range_fetched)
+            std::get<ParamAcquireTime>(params).store_range(exposure.limits.min_exposure,
+                                                           exposure.limits.max_exposure);
+        if (exposure_applied) {
+            setDoubleParam(ADAcquireTime, exposure.current.exposure);
+            std::get<ParamAcquireTime>(params).store(exposure.current.exposure);
+            setDoubleParam(BCAttenuation, exposure.current.attenuation);
+            std::get<ParamAttenuation>(params).store(exposure.current.attenuation);
+        }
+        if (exposure_level >= 0) {
+            setDoubleParam(BCExposureLevel, exposure_level);
+            setIntegerParam(BCExposureConverged, !exposure_converging);
+        }
+        if (exposure_converged) {
+            setDoubleParam(BCExposureConvergenceTime, exposure_converge_time * 1e3);
+            setIntegerParam(BCExposureConvergenceFrames, exposure_converge_frames);
+        }
+        if (!exposure_error.empty()) {
+            asynPrint(pasynUserSelf, ASYN_TRACE_ERROR, "%s\n", exposure_error.c_str());
+            setStringParam(ADStatusMessage, exposure_error.c_str());
+        }
+
+        if (!roi_error.empty()) {
+            asynPrint(pasynUserSelf, ASYN_TRACE_ERROR, "%s\n", roi_error.c_str());
+            setStringParam(ADStatusMessage, roi_error.c_str());
+        }
+
+        setIntegerParam(ADStatus, ADStatusReadout);
+        callParamCallbacks();
+
+        lap(StageCapture, capture_start);
+        return frame;
+    }
+
+    /* Applies the exposure change computed from the previous frame, and
+     * fetches the exposure time range if it is not cached. Called from within
+     * the capture thread's device command, before requesting a frame.
+     * Updates settings.current with the readbacks */
+    void apply_exposure(ViSession vi, ExposureControl &settings, bool &applied,
+                        bool &range_fetched)
+    {
+        if (!settings.range_cached) {
+            handle_tlbc2_err(vi, std::get<ParamAcquireTime>(params).get_range(
+                                     vi, settings.limits.min_exposure,
+                                     settings.limits.max_exposure),
+                             "get range of exposure_time");
+            settings.range_cached = range_fetched = true;
+        }
+
+        if (!exposure_change_pending)
+            return;
+        exposure_change_pending = false;
+
+        auto &exposure_time = std::get<ParamAcquireTime>(params);
+        auto &attenuation = std::get<ParamAttenuation>(params);
+
+        /* moving the filter is slow, so only touch it when needed */
+        if (exposure_change.attenuation != settings.current.attenuation) {
+            handle_tlbc2_err(vi, attenuation.set(vi, exposure_change.attenuation),
+                             "set", attenuation.name);
+            handle_tlbc2_err(vi, attenuation.get(vi, settings.current.attenuation),
+                             "get", attenuation.name);
+        }
+
+        handle_tlbc2_err(vi, exposure_time.set(vi, exposure_change.exposure),
+                         "set", exposure_time.name);
+        handle_tlbc2_err(vi, exposure_time.get(vi, settings.current.exposure),
+                         "get", exposure_time.name);
+        applied = true;
+    }
+
+    /* Computes the exposure change for the next frame from the level of
+     * the one just captured, and tracks convergence: from the first frame
+     * outside the tolerance to the first one back inside it. Returns true
+     * and the time it took when converging has just finished */
+    bool control_exposure(const ExposureControl &settings, const FrameLevels &levels,
+                          epicsUInt64 capture_start, double &converge_time)
+    {
+        const bool within = levels.level < 1. &&
+            std::fabs(levels.level - settings.target) <= settings.tolerance * settings.target;
+
+        if (!within) {
+            if (!exposure_converging) {
+                exposure_converging = true;
+                exposure_converge_start = capture_start;
+                exposure_converge_frames = 0;
+            }
+            exposure_converge_frames++;
+
+            exposure_change = next_exposure(levels, settings.target, settings.current,
+                                            settings.limits);
+            exposure_change_pending =
+                exposure_change.exposure != settings.current.exposure ||
+                exposure_change.attenuation != settings.current.attenuation;
+            return false;
+        }
+
+        if (!exposure_converging)
+            return false;
+
+        exposure_converging = false;
+        converge_time = (epicsMonotonicGet() - exposure_converge_start) * 1e-9;
+        return true;
+    }
+
+    /* Records where the beam was in a captured frame, for the auto ROI */
+    void track_beam(const Frame &frame, bool invalid_scan, ViUInt16 left, ViUInt16 top)
+    {
+        AutoRoiBeam &beam = auto_roi_beam;
+
+        if (invalid_scan) {
+            beam.state = AutoRoiBeam::Lost;
+        } else if (!frame.calculated) {
+            /* no news, keep what the last calculated frame said */
+        } else if (frame.moments_source == MomentsDriver) {
+            beam.state = frame.moments.valid ? AutoRoiBeam::Found : AutoRoiBeam::Lost;
+            beam.x = left + frame.moments.centroid_x;
+            beam.y = top + frame.moments.centroid_y;
+            beam.width_x = frame.moments.width_x_simple;
+            beam.width_y = frame.moments.width_y_simple;
+        } else {
+            beam.state = AutoRoiBeam::Found;
+            beam.x = left + frame.scan_data.centroidPositionX;
+            beam.y = top + frame.scan_data.centroidPositionY;
+            beam.width_x = std::max<double>(frame.scan_data.beamWidthIsoX, frame.scan_data.calcAreaWidth / 3);
+            beam.width_y = std::max<double>(frame.scan_data.beamWidthIsoY, frame.scan_data.calcAreaHeight / 3);
+        }
+    }
+
+    /* Moves the hardware ROI to the beam plus margin, or back to the full
+     * sensor when the beam is lost. The ROI is kept as long as the beam
+     * plus margin fits inside it and it is at most twice the needed size,
+     * so it does not follow every small movement. Called from within the
+     * capture thread's device command, between frames. Returns true and
+     * the new left, top, width and height if the ROI changed */
+    bool update_auto_roi(ViSession vi, const AutoRoiSettings &settings, ViUInt16 roi[4])
+    {
+        const AutoRoiBeam &beam = auto_roi_beam;
+        const epicsUInt64 now = epicsMonotonicGet();
+
+        if (beam.state == AutoRoiBeam::Unknown)
+            return false;
+
+        if (settings.max_rate > 0 && auto_roi_time &&
+            (now - auto_roi_time) * 1e-9 < 1. / settings.max_rate)
+            return false;
+
+        int left = 0, top = 0, width = settings.max_x, height = settings.max_y;
+
+        if (beam.state == AutoRoiBeam::Found) {
+            auto fit = [&](double center, double beam_width, int max, int &start, int &size) {
+                size = std::clamp((int)std::ceil(settings.margin * beam_width),
+                                  std::min(auto_roi_min_size, max), max);
+                start = std::clamp((int)std::lround(center - size / 2.), 0, max - size);
+            };
+
+            fit(beam.x, beam.width_x, settings.max_x, left, width);
+            fit(beam.y, beam.width_y, settings.max_y, top, height);
+
+            auto keep = [](int start, int size, int current_start, int current_size) {
+                return start >= current_start &&
+                    start + size <= current_start + current_size &&
+                    current_size <= 2 * size;
+            };
+
+            if (keep(left, width, roi_left, roi_width) &&
+                keep(top, height, roi_top, roi_height))
+                return false;
+        } else if (roi_left == 0 && roi_top == 0 && roi_width == settings.max_x &&
+                   roi_height == settings.max_y) {
+            return false;
+        }
+
+        set_roi(vi, left, top, width, height, settings.max_x, settings.max_y);
+        get_roi(vi, roi[0], roi[1], roi[2], roi[3]);
+
+        const epicsUInt64 done = epicsMonotonicGet();
+        auto_roi_seconds += (done - now) * 1e-9;
+        auto_roi_changes++;
+        auto_roi_time = done;
+
+        /* positions from frames of the old ROI are stale now */
+        auto_roi_beam.state = AutoRoiBeam::Unknown;
+
+        return true;
+    }
+
+    /* Decides whether the frame being captured gets beam calculations: the
+     * first one does, then every decimation-th frame as long as max_rate
+     * (if set) is not exceeded */
+    bool calculation_due(int decimation, double max_rate, epicsUInt64 now)
+    {
+        if (calc_time) {
+            if (++frames_since_calc < (unsigned)std::max(decimation, 1))
+                return false;
+
+            if (max_rate > 0 && (now - calc_time) * 1e-9 < 1. / max_rate)
+                return false;
+        }
+
+        frames_since_calc = 0;
+        calc_time = now;
+        return true;
+    }
+
+    /* Hands a frame over to the publisher, blocking while the queue is full */
+    void queue_frame(Frame &frame) {
+        const epicsUInt64 t = epicsMonotonicGet();
+
+        if (frame_queue.trySend(&frame, sizeof frame) < 0) {
+            incrementParam(BCCaptureStalls);
+            callParamCallbacks();
+
+            PortUnlocker unlocker(*this);
+            frame_queue.send(&frame, sizeof frame);
+        }
+
+        updateQueueDepth();
+        lap(StageQueue, t);
+    }
+
+    /* Updates the achieved frame and calculation rates about once a second.
+     * The frame rate over a second of full frames is the reference for the
+     * auto ROI's frame rate gain */
+    void updateRates(bool calculated, bool full_frame)
+    {
+        const epicsUInt64 now = epicsMonotonicGet();
+
+        rate_frames++;
+        if (calculated)
+            rate_calcs++;
+        rate_full_frames &= full_frame;
+
+        if (!rate_start) {
+            rate_start = now;
+            rate_frames = rate_calcs = 0;
+            rate_full_frames = true;
+            return;
+        }
+
+        const double elapsed = (now - rate_start) * 1e-9;
+        if (elapsed < 1.)
+            return;
+
+        const double fps = rate_frames / elapsed;
+
+        if (rate_full_frames)
+            full_frame_fps = fps;
+
+        setDoubleParam(BCAchievedFps, fps);
+        setDoubleParam(BCCalcFps, rate_calcs / elapsed);
+        setDoubleParam(BCAutoRoiFpsGain, full_frame_fps > 0 ? fps / full_frame_fps : 1.);
+        rate_start = now;
+        rate_frames = rate_calcs = 0;
+        rate_full_frames = true;
+    }
+
+    /* Makes room in the frame pool for the next frame according to
+     * FRAME_POOL_POLICY. Returns false if the frame is to be skipped, or if
+     * a stop was requested while waiting, which is left for
+     * wait_frame_deadline() to see */
+    bool make_frame_room() {
+        /* the pre-trigger ring gives up its oldest frames before capture
+         * waits or drops frames */
+        while (frame_pool.exhausted() && !burst_ring.empty())
+            dropBurstFrame();
+        if (!frame_pool.exhausted())
+            return true;
+
+        int policy;
+        getIntegerParam(BCFramePoolPolicy, &policy);
+
+        /* frames that reached the plugins cannot be taken back, so with
+         * none waiting to be published this waits like PoolBlock */
+        if (policy == PoolDropOldest) {
+            Frame oldest;
+            while (frame_pool.exhausted() &&
+                   frame_queue.tryReceive(&oldest, sizeof oldest) >= 0) {
+                oldest.image->release();
+                incrementParam(BCFramePoolDroppedOldest);
+            }
+            updateQueueDepth();
+        }
+
+        if (policy == PoolDropNewest) {
+            /* give the plugins the time of one exposure to catch up */
+            double exposure;
+            getDoubleParam(ADAcquireTime, &exposure);
+            {
+                PortUnlocker unlocker(*this);
+                frame_pool.waitRelease(std::max(exposure, 1e-3));
+            }
+
+            if (frame_pool.exhausted()) {
+                incrementParam(BCFramePoolDroppedNewest);
+                callParamCallbacks();
+                return false;
+            }
+            return true;
+        }
+
+        if (!frame_pool.exhausted())
+            return true;
+
+        incrementParam(BCFramePoolStalls);
+        callParamCallbacks();
+
+        PortUnlocker unlocker(*this);
+        while (frame_pool.exhausted()) {
+            if (!frame_pool.waitRelease(0.1) && stop_acquire_event.tryWait()) {
+                stop_acquire_event.trigger();
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void incrementParam(int param)
+    {
+        int value;
+        getIntegerParam(param, &value);
+        setIntegerParam(param, value + 1);
+    }
+
+    void updateFramePool()
+    {
+        int in_use = frame_pool.inUse(), high_water;
+
+        getIntegerParam(BCFramePoolHighWater, &high_water);
+        setIntegerParam(BCFramePoolInUse, in_use);
+        if (in_use > high_water)
+            setIntegerParam(BCFramePoolHighWater, in_use);
+    }
+
+    void updateQueueDepth()
+    {
+        int depth = frame_queue.pending(), high_water;
+
+        getIntegerParam(BCQueueHighWater, &high_water);
+        setIntegerParam(BCQueueDepth, depth);
+        if (depth > high_water)
+            setIntegerParam(BCQueueHighWater, depth);
+    }
+
+    /* Waits until every queued frame has been published */
+    void drain_pipeline() {
+        Frame end = {};
+
+        capturing = false;
+        PortUnlocker unlocker(*this);
+        frame_queue.send(&end, sizeof end);
+        publish_done_event.wait();
+    }
+
+    void publish_frame(Frame &frame) {
+        auto pImage = frame.image;
+
+        /* these functions need to update the paramList before getAttributes
+         * is called, since getAttributes might be configured to get
+         * parameters from the paramList */
+        updateCounters();
+        getIntegerParam(NDArrayCounter, &pImage->uniqueId);
+        if (frame.exposure_time >= 0) {
+            setDoubleParam(ADAcquireTime, frame.exposure_time);
+            std::get<ParamAcquireTime>(params).store(frame.exposure_time);
+        }
+        if (frame.calculated) {
+            if (frame.moments_source == MomentsDriver)
+                updateParamsWithMoments(frame.moments);
+            else
+                updateParamsWithCalculations(frame.scan_data);
+            if (frame.moments_source == MomentsCrossCheck)
+                updateMomentsDifference(frame.moments, frame.scan_data);
+        }
+        updateCacheCounters();
+        int max_x, max_y;
+        getIntegerParam(ADMaxSizeX, &max_x);
+        getIntegerParam(ADMaxSizeY, &max_y);
+        updateRates(frame.calculated, pImage->dims[0].size == (size_t)max_x &&
+                                      pImage->dims[1].size == (size_t)max_y);
+
+        int arrayCallbacks, results_only;
+        getIntegerParam(NDArrayCallbacks, &arrayCallbacks);
+        getIntegerParam(BCResultsOnly, &results_only);
+
+        /* pre-trigger frames were stamped when they were captured */
+        if (!frame.burst || frame.burst_frame >= 0)
+            updateTimeStamps(pImage);
+
+        if (frame.calculated &&
+            (frame.moments_source != MomentsDriver || frame.moments.valid)) {
+            ResultSample sample = resultSample(pImage, frame.scan_data);
+
+            queueResults(sample);
+            accumulateStability(sample);
+        }
+
+        int profile_enable;
+        getIntegerParam(BCProfileEnable, &profile_enable);
+        if (profile_enable)
+            publishProfiles(frame);
+
+        double codec_ratio = 0, codec_throughput = 0;
+
+        if (arrayCallbacks && !results_only) {
+          epicsUInt64 t = epicsMonotonicGet();
+
+          getAttributes(pImage->pAttributeList);
+          if (frame.calculated && frame.moments_source == MomentsDriver)
+              addAttributesFromMoments(pImage, frame.moments);
+          else if (frame.calculated)
+              addAttributesFromScan(pImage, frame.scan_data);
+          else
+              frame_attributes.detach(pImage);
+          /* reused arrays keep the attributes of their previous frame */
+          if (frame.accumulated)
+              pImage->pAttributeList->add("NumFramesAccumulated",
+                                          "Number of frames accumulated", NDAttrInt32,
+                                          &frame.accumulated);
+          else
+              pImage->pAttributeList->remove("NumFramesAccumulated");
+          if (frame.burst)
+              pImage->pAttributeList->add("BurstFrame",
+                                          "Frame number relative to the burst trigger",
+                                          NDAttrInt32, &frame.burst_frame);
+          else
+              pImage->pAttributeList->remove("BurstFrame");
+          t = lap(StageAttributes, t);
+
+          offerPreview(pImage);
+
+          int codec;
+          getIntegerParam(BCCodec, &codec);
+
+          /* plugins may block on their own locks while calling back into
+           * the driver */
+          PortUnlocker unlocker(*this);
+          NDArray *pOutput = pImage;
+
+          if (codec == CodecBSLZ4) {
+              t = epicsMonotonicGet();
+              NDArray *pCompressed = compressFrame(pImage);
+              const epicsUInt64 now = lap(StageCodec, t);
+
+              /* plugins get the uncompressed frame if compression failed */
+              if (pCompressed) {
+                  codec_ratio = (double)pImage->dataSize / pCompressed->compressedSize;
+                  codec_throughput = pImage->dataSize / ((now - t) * 1e-9) / 1e6;
+                  pOutput = pCompressed;
+              }
+          }
+
+          t = epicsMonotonicGet();
+          doCallbacksGenericPointer(pOutput, NDArrayData, 0);
+          lap(StageCallbacks, t);
+
+          if (pOutput != pImage)
+              pOutput->release();
         }
 
-        return ADDriver::writeInt32(pasynUser, value);
+        if (codec_ratio > 0) {
+            setDoubleParam(BCCodecRatio, codec_ratio);
+            setDoubleParam(BCCodecThroughput, codec_throughput);
+        }
+
+        pImage->release();
+        updateLatency(false);
+
+        callParamCallbacks();
     }
 
-    asynStatus runAmbientLightCorrection(asynUser *user)
+    /* Projects a frame onto X and Y, fits the profiles and publishes both.
+     * With PROFILE_ROTATE, the axes follow the SDK's calculation area when
+     * the frame has scan data. Called by the publisher, which releases the
+     * port lock while computing */
+    void publishProfiles(const Frame &frame)
     {
-        ViUInt8 mode;
+        int rotate;
+        getIntegerParam(BCProfileRotate, &rotate);
+
+        const NDArray *image = frame.image;
+        const size_t width = image->dims[0].size, height = image->dims[1].size;
+        const double angle = rotate && frame.calculated &&
+            frame.moments_source != MomentsDriver ? frame.scan_data.calcAreaAngle : 0.;
+        GaussianFit fits[NumProfiles];
+
+        {
+            PortUnlocker unlocker(*this);
+            const epicsUInt64 t = epicsMonotonicGet();
+
+            if (image->dataType == NDUInt32)
+                profiles.project(publish_workers, (const epicsUInt32 *)image->pData, width, height, angle);
+            else if (image->dataType == NDUInt16)
+                profiles.project(publish_workers, (const epicsUInt16 *)image->pData, width, height, angle);
+            else
+                profiles.project(publish_workers, (const epicsUInt8 *)image->pData, width, height, angle);
+
+            fits[ProfileX] = fit_gaussian(profiles.x().data(), profiles.pixelsX().data(),
+                                          profiles.x().size());
+            fits[ProfileY] = fit_gaussian(profiles.y().data(), profiles.pixelsY().data(),
+                                          profiles.y().size());
+            lap(StageProfiles, t);
+        }
 
-        try {
-            handle_tlbc2_err(
-                TLBC2_get_ambient_light_correction_status(instr, &mode),
-                "get_ambient_light_correction_status");
+        setDoubleParam(BCProfileAngle, angle);
+
+        for (int axis = 0; axis < NumProfiles; axis++) {
+            const std::vector<double> &profile = axis == ProfileX ? profiles.x() : profiles.y();
+            const GaussianFit &fit = fits[axis];
+            const int fit_params[] = {BCProfileAmplitude[axis], BCProfileBackground[axis],
+                                      BCProfileCenter[axis], BCProfileRating[axis],
+                                      BCProfileWidth[axis]};
+
+            /* asyn does not modify the array */
+            doCallbacksFloat64Array(const_cast<double *>(profile.data()), profile.size(),
+                                    BCProfile[axis], 0);
+
+            setDoubleParam(BCProfileAmplitude[axis], fit.amplitude);
+            setDoubleParam(BCProfileBackground[axis], fit.background);
+            setDoubleParam(BCProfileCenter[axis], fit.center);
+            setDoubleParam(BCProfileRating[axis], fit.rating);
+            setDoubleParam(BCProfileWidth[axis], fit.width);
+
+            /* a profile without a peak leaves the fit in alarm */
+            for (int param : fit_params) {
+                setParamAlarmStatus(param, fit.valid ? epicsAlarmNone : epicsAlarmCalc);
+                setParamAlarmSeverity(param, fit.valid ? epicsSevNone : epicsSevInvalid);
+            }
+        }
+    }
 
-            if (mode == AMBIENT_LIGHT_CORRECTION_NEVER_RUN ||
-                mode == AMBIENT_LIGHT_CORRECTION_FAILED) {
-                setIntegerParam(BCComputeAmbientLightCorrection, 1);
-                callParamCallbacks();
+    /* Returns a bslz4 compressed copy of a frame, with its attributes and
+     * metadata, or NULL on errors. Called by the publisher without the port
+     * lock */
+    NDArray *compressFrame(NDArray *pImage)
+    {
+        NDArrayInfo_t info;
+        pImage->getInfo(&info);
+
+        size_t dims[ND_ARRAY_MAX_DIMS];
+        for (int i = 0; i < pImage->ndims; i++)
+            dims[i] = pImage->dims[i].size;
+
+        NDArray *pCompressed = pNDArrayPool->alloc(pImage->ndims, dims, pImage->dataType,
+            bslz4_bound(info.nElements, info.bytesPerElement), NULL);
+        if (!pCompressed) {
+            asynPrint(pasynUserSelf, ASYN_TRACE_ERROR,
+                      "ADTLBC2: failed to allocate compressed NDArray\n");
+            return NULL;
+        }
 
-                handle_tlbc2_err(TLBC2_run_ambient_light_correction(instr),
-                                 "run_ambient_light_correction");
-            }
-            setIntegerParam(BCComputeAmbientLightCorrection, 0);
-            setIntegerParam(BCAmbientLightCorrectionStatus, 1);
-            callParamCallbacks();
-        } catch (const std::runtime_error &err) {
-            asynPrint(user, ASYN_TRACE_ERROR, "%s\n", err.what());
-            setStringParam(ADStatusMessage, err.what());
-            callParamCallbacks();
+        pNDArrayPool->copy(pImage, pCompressed, false);
 
-            return asynError;
+        const size_t size = compress_bslz4(publish_workers, pImage->pData, info.nElements,
+                                           info.bytesPerElement, pCompressed->pData);
+        if (!size) {
+            asynPrint(pasynUserSelf, ASYN_TRACE_ERROR, "ADTLBC2: bslz4 compression failed\n");
+            pCompressed->release();
+            return NULL;
         }
 
-        return asynSuccess;
+        pCompressed->codec.name = "bslz4";
+        pCompressed->compressedSize = size;
+        return pCompressed;
     }
 
-    asynStatus writeROI(asynUser *user, int value)
+    /* Records the time since start for a stage and returns the current time,
+     * so consecutive stages can be chained */
+    epicsUInt64 lap(int stage, epicsUInt64 start)
     {
-        int sizex, sizey, minx, miny;
-        asynStatus status = asynSuccess;
-        const int param = user->reason;
+        const epicsUInt64 now = epicsMonotonicGet();
 
-        getIntegerParam(ADSizeX, &sizex);
-        getIntegerParam(ADSizeY, &sizey);
-        getIntegerParam(ADMinX, &minx);
-        getIntegerParam(ADMinY, &miny);
+        latency[stage].record(now - start);
+        return now;
+    }
 
-        if (param == ADSizeX)
-            sizex = value;
-        else if (param == ADSizeY)
-            sizey = value;
-        else if (param == ADMinX)
-            minx = value;
-        else if (param == ADMinY)
-            miny = value;
+    /* Publishes the latency histograms, about once a second unless forced */
+    void updateLatency(bool force)
+    {
+        const epicsUInt64 now = epicsMonotonicGet();
+        if (!force && (now - latency_publish_time) * 1e-9 < 1.)
+            return;
+        latency_publish_time = now;
 
-        try {
-            ViBoolean automatic;
-            ViUInt8 form;
-            epicsInt32 maxSizeX, maxSizeY;
+        epicsFloat64 buckets[LatencyHistogram::num_buckets];
+        epicsInt32 counts[LatencyHistogram::num_buckets];
 
-            getIntegerParam(ADMaxSizeX, &maxSizeX);
-            getIntegerParam(ADMaxSizeY, &maxSizeY);
+        for (size_t i = 0; i < LatencyHistogram::num_buckets; i++)
+            buckets[i] = LatencyHistogram::bucket_start(i);
+        doCallbacksFloat64Array(buckets, LatencyHistogram::num_buckets, BCLatencyBuckets, 0);
 
-            handle_tlbc2_err(
-                TLBC2_get_calculation_area_mode(instr, &automatic, &form),
-                "get_calculation_area_mode");
+        for (int stage = 0; stage < NumStages; stage++) {
+            auto summary = latency[stage].summary();
 
-            handle_tlbc2_err(TLBC2_set_calculation_area_mode(instr, VI_ON, 0),
-                             "set_calculation_area_mode");
+            setDoubleParam(BCLatencyP50[stage], summary.p50);
+            setDoubleParam(BCLatencyP99[stage], summary.p99);
+            setDoubleParam(BCLatencyMax[stage], summary.max);
 
-            /* resetting the user calculation area is necessary to avoid
-             * triggering a segfault in the library code */
-            handle_tlbc2_err(
-                TLBC2_set_user_calculation_area(instr, 0, 0, maxSizeX, maxSizeY, 0),
-                "set_user_calculation_area");
+            latency[stage].snapshot(counts);
+            doCallbacksInt32Array(counts, LatencyHistogram::num_buckets,
+                                  BCLatencyHistogram[stage], 0);
+        }
+    }
 
-            handle_tlbc2_err(TLBC2_set_roi(instr, (ViUInt16)minx,
-                                           (ViUInt16)miny, (ViUInt16)sizex,
-                                           (ViUInt16)sizey),
-                             "set_roi");
+    /* The beam parameters just published for a frame */
+    ResultSample resultSample(NDArray *image, const TLBC1_Calculations &data)
+    {
+        ResultSample sample;
+
+        sample.frame = image->uniqueId;
+        sample.values[ResultTimestamp] = image->timeStamp;
+        getDoubleParam(BCCentroidX, &sample.values[ResultCentroidX]);
+        getDoubleParam(BCCentroidY, &sample.values[ResultCentroidY]);
+        getDoubleParam(BCBeamWidthX, &sample.values[ResultWidthX]);
+        getDoubleParam(BCBeamWidthY, &sample.values[ResultWidthY]);
+        getDoubleParam(BCSaturation, &sample.values[ResultSaturation]);
+        sample.values[ResultPower] = data.totalPower;
+
+        return sample;
+    }
 
-            handle_tlbc2_err(
-                TLBC2_set_calculation_area_mode(instr, automatic, form),
-                "set_calculation_area_mode");
+    /* Appends a frame's results to the results stream */
+    void queueResults(const ResultSample &sample)
+    {
+        if (!results_ring.push(sample))
+            setIntegerParam(BCResultsOverruns, ++results_overruns);
+        else if (results_ring.size() >= results_batch_size)
+            results_event.trigger();
+    }
 
-        } catch (const std::runtime_error &err) {
-            asynPrint(user, ASYN_TRACE_ERROR, "%s\n", err.what());
-            setStringParam(ADStatusMessage, err.what());
+    void accumulateStability(const ResultSample &sample)
+    {
+        for (int c = 0; c < num_stability_channels; c++)
+            stability[c].add(sample.values[stability_results[c]]);
 
-            status = asynError;
+        if (!stability_samples++)
+            stability_first_time = sample.values[ResultTimestamp];
+        stability_last_time = sample.values[ResultTimestamp];
+
+        updateStability(false);
+    }
+
+    /* Publishes the stability statistics. The Allan deviation waveforms are
+     * only sent about once a second unless forced */
+    void updateStability(bool force)
+    {
+        for (int c = 0; c < num_stability_channels; c++) {
+            auto stats = stability[c].stats();
+
+            setDoubleParam(BCStability[c][StabilityMean], stats.mean);
+            setDoubleParam(BCStability[c][StabilityRms], stats.rms);
+            setDoubleParam(BCStability[c][StabilityMin], stats.min);
+            setDoubleParam(BCStability[c][StabilityMax], stats.max);
+            setDoubleParam(BCStability[c][StabilityPeakToPeak], stats.max - stats.min);
         }
 
-        try {
-            ViUInt16 left, top, width, height;
+        setIntegerParam(BCStabilitySamples, stability_samples);
 
-            handle_tlbc2_err(TLBC2_get_roi(instr, &left, &top, &width, &height),
-                             "get_roi");
+        const epicsUInt64 now = epicsMonotonicGet();
+        if (!force && (now - stability_publish_time) * 1e-9 < 1.)
+            return;
+        stability_publish_time = now;
 
-            setIntegerParam(ADMinX, left);
-            setIntegerParam(ADMinY, top);
-            setIntegerParam(ADSizeX, width);
-            setIntegerParam(ADSizeY, height);
+        double adev[StabilityAccumulator::num_taus];
+        double tau[StabilityAccumulator::num_taus];
+        const double interval = stability_samples > 1 ?
+            (stability_last_time - stability_first_time) / (stability_samples - 1) : 0;
 
-            callParamCallbacks();
-        } catch (const std::runtime_error &err) {
-            asynPrint(user, ASYN_TRACE_ERROR, "%s\n", err.what());
-            setStringParam(ADStatusMessage, err.what());
-            callParamCallbacks();
+        for (size_t k = 0; k < StabilityAccumulator::num_taus; k++)
+            tau[k] = interval * (1 << k);
+        doCallbacksFloat64Array(tau, StabilityAccumulator::num_taus, BCStabilityTau, 0);
 
-            return asynError;
+        for (int c = 0; c < num_stability_channels; c++) {
+            stability[c].allan_deviation(adev);
+            doCallbacksFloat64Array(adev, StabilityAccumulator::num_taus,
+                                    BCStabilityAdev[c], 0);
         }
-
-        return status;
     }
 
-    asynStatus writeFloat64(asynUser *pasynUser, epicsFloat64 value) override
+    void resetStability(int window)
     {
-        const int function = pasynUser->reason;
-        ViReal64 readback;
+        for (auto &accumulator : stability)
+            accumulator.set_window(window);
 
-        try {
-            auto item = params.find(function);
+        stability_samples = 0;
+        stability_first_time = stability_last_time = 0;
+        updateStability(true);
+    }
 
-            if (item != params.end()) {
-                auto param = std::get<Parameter<ViReal64>>(item->second);
+    /* Results thread: publishes the queued results as waveforms every
+     * RESULTS_PERIOD, or as soon as a full batch is waiting */
+    void stream_results() {
+        while (true) {
+            double period;
 
-                asynStatus status =
-                    writeParam<ViReal64>(pasynUser, param, value, readback);
+            lock();
+            getDoubleParam(BCResultsPeriod, &period);
+            unlock();
 
-                setDoubleParam(function, readback);
+            results_event.wait(std::max(period, 0.01));
 
-                if (function == ADAcquireTime)
-                    setIntegerParam(BCAutoExposure, 0);
+            while (true) {
+                ResultSample sample;
+                size_t count = 0;
 
-                callParamCallbacks();
-                return status;
-            }
+                while (count < results_batch_size && results_ring.pop(sample)) {
+                    for (int i = 0; i < NumResults; i++)
+                        results_batch[i][count] = sample.values[i];
+                    results_batch_frames[count] = sample.frame;
+                    count++;
+                }
 
-            return ADDriver::writeFloat64(pasynUser, value);
-        } catch (const std::runtime_error &err) {
-            asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s\n", err.what());
-            setStringParam(ADStatusMessage, err.what());
-            callParamCallbacks();
+                if (!count)
+                    break;
 
-            return asynError;
+                lock();
+                for (int i = 0; i < NumResults; i++)
+                    doCallbacksFloat64Array(results_batch[i], count, BCResults[i], 0);
+                doCallbacksInt32Array(results_batch_frames, count, BCResultsFrame, 0);
+                setIntegerParam(BCResultsCount, count);
+                callParamCallbacks();
+                unlock();
+            }
         }
     }
 
-    asynStatus readFloat64(asynUser *pasynUser, epicsFloat64 *value)
+    /* Hands a published frame to the preview thread if the preview is
+     * enabled and its rate limit allows */
+    void offerPreview(NDArray *image)
     {
-        const int function = pasynUser->reason;
+        int enable;
+        double max_rate;
+        getIntegerParam(BCPreviewEnable, &enable);
+        getDoubleParam(BCPreviewMaxRate, &max_rate);
 
-        auto item = params.find(function);
+        /* the binning takes 8 and 16 bit frames, not accumulated sums */
+        if (!enable || image->dataType == NDUInt32)
+            return;
+
+        const epicsUInt64 now = epicsMonotonicGet();
+        if (max_rate > 0 && preview_time &&
+            (now - preview_time) * 1e-9 < 1. / max_rate)
+            return;
+        preview_time = now;
 
-        if (item != params.end()) {
-            auto param = std::get<Parameter<ViReal64>>(item->second);
+        PreviewRequest request = {image, 0, PreviewMean}, replaced;
+        getIntegerParam(BCPreviewBinning, &request.binning);
+        getIntegerParam(BCPreviewMode, &request.mode);
 
-            readbackParam<ViReal64>(function, param);
-            callParamCallbacks();
+        image->reserve();
+        {
+            epicsGuard<epicsMutex> guard(preview_mutex);
+
+            replaced = preview_request;
+            preview_request = request;
         }
+        preview_event.trigger();
 
-        return ADDriver::readFloat64(pasynUser, value);
+        if (replaced.image) {
+            replaced.image->release();
+            setIntegerParam(BCPreviewDropped, ++preview_dropped);
+        }
     }
 
-    bool try_wait_acquire_period(epicsTimeStamp startTime) {
-        epicsTimeStamp endTime;
-        double elapsedTime, delay, acquirePeriod;
+    /* Bins a frame into a new array. Called without the port lock */
+    NDArray *bin_image(const PreviewRequest &request)
+    {
+        NDArray *image = request.image;
+        const unsigned factor = request.binning;
+        const bool mean = request.mode == PreviewMean || factor == 1;
+        const size_t width = image->dims[0].size, height = image->dims[1].size;
+        size_t dims[] = {width / factor, height / factor};
+
+        if (!dims[0] || !dims[1])
+            throw std::runtime_error("preview: frame is smaller than the binning");
+
+        NDDataType_t type = image->dataType;
+        if (!mean)
+            type = type == NDUInt16 ? NDUInt32 : NDUInt16;
+
+        NDArray *binned = this->pNDArrayPool->alloc(2, dims, type, 0, NULL);
+        if (!binned)
+            throw std::runtime_error("preview: failed to allocate NDArray");
+
+        if (image->dataType == NDUInt16 && mean)
+            bin_frame_mean((epicsUInt16 *)image->pData, width, height, factor,
+                           (epicsUInt16 *)binned->pData);
+        else if (image->dataType == NDUInt16)
+            bin_frame_sum((epicsUInt16 *)image->pData, width, height, factor,
+                          (epicsUInt32 *)binned->pData);
+        else if (mean)
+            bin_frame_mean((epicsUInt8 *)image->pData, width, height, factor,
+                           (epicsUInt8 *)binned->pData);
+        else
+            bin_frame_sum((epicsUInt8 *)image->pData, width, height, factor,
+                          (epicsUInt16 *)binned->pData);
+
+        binned->dims[0].binning = binned->dims[1].binning = factor;
+        binned->uniqueId = image->uniqueId;
+        binned->timeStamp = image->timeStamp;
+        binned->epicsTS = image->epicsTS;
+        image->pAttributeList->copy(binned->pAttributeList);
+
+        return binned;
+    }
 
-        epicsTimeGetCurrent(&endTime);
-        elapsedTime = epicsTimeDiffInSeconds(&endTime, &startTime);
-        getDoubleParam(ADAcquirePeriod, &acquirePeriod);
-        delay = acquirePeriod - elapsedTime;
+    /* Preview thread: bins offered frames and publishes them on address 1,
+     * away from the capture and publisher threads */
+    void preview_frames() {
+        while (true) {
+            PreviewRequest request;
 
-        setIntegerParam(ADStatus, ADStatusWaiting);
-        callParamCallbacks();
+            preview_event.wait();
+            {
+                epicsGuard<epicsMutex> guard(preview_mutex);
 
-        /* If delay is exactly 0 then this thread never sleeps and the mutex is locked again
-         * before any of the other threads can lock it. This means that the background thread
-         * which runs the writeInt32 function can never trigger stop_acquire_event and
-         * acquisition is never stopped. To mitigate this we set a minimal delay which is
-         * imperceptible but still causes the current thread to sleep, allowing the other
-         * thread to reliably wake up and trigger the stop_acquire_event */
-        if (delay < 0.) delay = 0.001;
+                request = preview_request;
+                preview_request.image = nullptr;
+            }
 
-        unlock();
-        /* .wait() returns true if the event was triggered, false if it timed out */
-        bool stop_acquisition = stop_acquire_event.wait(delay);
-        lock();
-        return stop_acquisition;
-    }
+            if (!request.image)
+                continue;
 
-    void acquire_image() {
-        setIntegerParam(ADStatus, ADStatusAcquire);
-        callParamCallbacks();
+            NDArray *binned = nullptr;
+            try {
+                binned = bin_image(request);
+            } catch (const std::exception &err) {
+                asynPrint(pasynUserSelf, ASYN_TRACE_ERROR, "%s\n", err.what());
+            }
+            request.image->release();
 
-        ViUInt16 width, height;
-        ViUInt8 bpp;
+            if (!binned)
+                continue;
 
-        handle_tlbc2_err(TLBC2_request_new_measurement(instr), "request_new_measurement");
-        handle_tlbc2_err(TLBC2_get_scan_data(instr, &scan_data), "get_scan_data");
-        if (!scan_data.isValid)
-            throw std::runtime_error("scan data is invalid");
-        handle_tlbc2_err(TLBC2_get_image(instr, image_data, &width, &height, &bpp), "get_image");
+            NDArrayInfo_t info;
+            binned->getInfo(&info);
 
-        setIntegerParam(ADStatus, ADStatusReadout);
-        callParamCallbacks();
+            lock();
 
-        size_t dims[] = {width, height};
-        auto pImage = this->pNDArrayPool->alloc(2, dims, bpp == 2 ? NDUInt16 : NDUInt8, 0, NULL);
-        memcpy(pImage->pData, image_data, width * height * bpp);
+            int counter;
+            getIntegerParam(1, NDArrayCounter, &counter);
+            setIntegerParam(1, NDArrayCounter, counter + 1);
+            setIntegerParam(1, NDArraySizeX, binned->dims[0].size);
+            setIntegerParam(1, NDArraySizeY, binned->dims[1].size);
+            setIntegerParam(1, NDArraySize, info.totalBytes);
+            setIntegerParam(1, NDDataType, binned->dataType);
+            callParamCallbacks(1);
+
+            {
+                PortUnlocker unlocker(*this);
+                doCallbacksGenericPointer(binned, NDArrayData, 1);
+            }
 
-        /* these functions need to update the paramList before getAttributes
-         * is called, since getAttributes might be configured to get
-         * parameters from the paramList */
-        updateCounters();
-        readAcquireTime();
-        updateParamsWithCalculations(scan_data);
+            unlock();
+            binned->release();
+        }
+    }
 
-        int arrayCallbacks;
-        getIntegerParam(NDArrayCallbacks, &arrayCallbacks);
+    /* Publisher thread: decorates queued frames and passes them to the
+     * plugins while the capture thread already works on the next one */
+    void publish_frames() {
+        lock();
 
-        updateTimeStamps(pImage);
+        while (true) {
+            Frame frame;
 
-        if (arrayCallbacks) {
-          getAttributes(pImage->pAttributeList);
-          addAttributesFromScan(pImage, scan_data);
+            if (frame_queue.tryReceive(&frame, sizeof frame) < 0) {
+                /* only waiting in the middle of an acquisition is a stall */
+                if (capturing) {
+                    incrementParam(BCPublishStalls);
+                    callParamCallbacks();
+                }
 
-          doCallbacksGenericPointer(pImage, NDArrayData, 0);
-        }
+                PortUnlocker unlocker(*this);
+                frame_queue.receive(&frame, sizeof frame);
+            }
 
-        pImage->release();
+            updateQueueDepth();
 
-        callParamCallbacks();
+            /* a frame without an image marks the end of an acquisition */
+            if (!frame.image) {
+                callParamCallbacks();
+                publish_done_event.trigger();
+                continue;
+            }
+
+            publish_frame(frame);
+        }
     }
 
     void do_acquisition() {
@@ -433,40 +3079,130 @@ class epicsShareClass ADTLBC2: ADDriver, epicsThreadRunable {
         setIntegerParam(ADStatus, ADStatusAcquire);
         setIntegerParam(ADNumImagesCounter, 0);
         setIntegerParam(ADAcquire, 1);
+        setIntegerParam(BCQueueHighWater, 0);
+        setIntegerParam(BCCaptureStalls, 0);
+        setIntegerParam(BCPublishStalls, 0);
+        setIntegerParam(BCInvalidScans, 0);
+        setIntegerParam(BCAutoRoiChanges, 0);
+        setDoubleParam(BCAutoRoiTime, 0);
+        setDoubleParam(BCPeriodAchieved, 0);
+        setDoubleParam(BCPeriodJitter, 0);
+        setDoubleParam(BCPeriodLatenessMax, 0);
+        setIntegerParam(BCPeriodOverruns, 0);
+        setIntegerParam(BCFramePoolDroppedNewest, 0);
+        setIntegerParam(BCFramePoolDroppedOldest, 0);
+        setIntegerParam(BCFramePoolHighWater, 0);
+        setIntegerParam(BCFramePoolStalls, 0);
+        setIntegerParam(BCBurstCount, 0);
         callParamCallbacks();
 
-        int imageMode;
+        auto_roi_beam.state = AutoRoiBeam::Unknown;
+        auto_roi_time = 0;
+        auto_roi_changes = 0;
+        auto_roi_seconds = 0;
+        calc_time = 0;
+        invalid_scans = 0;
+        rate_start = 0;
+        frame_deadline = epicsMonotonicGet();
+        frame_start = 0;
+        period_overruns = 0;
+        period_lateness_max = 0;
+        period_count = 0;
+        period_mean = period_m2 = 0;
+        capturing = true;
+
+        int imageMode, pool_size, accumulate_frames, accumulate_mode, burst_mode;
         getIntegerParam(ADImageMode, &imageMode);
-        switch (imageMode) {
-            case ADImageSingle:
-                acquire_image();
-                break;
+        getIntegerParam(BCFramePoolSize, &pool_size);
+        getIntegerParam(BCAccumulateFrames, &accumulate_frames);
+        getIntegerParam(BCAccumulateMode, &accumulate_mode);
+        getIntegerParam(BCBurstMode, &burst_mode);
+        setIntegerParam(BCAccumulateProgress, 0);
+
+        /* allocate and touch the buffers for the current ROI up front */
+        {
+            const size_t frame_size = (size_t)roi_width * roi_height * max_bytes_per_pixel;
+            PortUnlocker unlocker(*this);
+            frame_pool.prewarm(pool_size, frame_size);
+        }
+        updateFramePool();
 
-            case ADImageMultiple:
-            case ADImageContinuous:
-                while(true) {
-                    epicsTimeStamp startTime;
-                    epicsTimeGetCurrent(&startTime);
-
-                    acquire_image();
-
-                    if (imageMode == ADImageMultiple) {
-                        int numImagesCounter, numImages;
-                        getIntegerParam(ADNumImagesCounter, &numImagesCounter);
-                        getIntegerParam(ADNumImages, &numImages);
-                        if (numImagesCounter >= numImages) {
-                            break;
-                        }
+        try {
+            int captured = 0;
+            bool complete = false;
+
+            /* queues a frame, and returns true once the image mode has
+             * enough of them */
+            auto publish = [&](Frame &frame) {
+                queue_frame(frame);
+                captured++;
+                updateFramePool();
+
+                if (imageMode == ADImageSingle)
+                    return true;
+
+                if (imageMode == ADImageMultiple) {
+                    int numImages;
+                    getIntegerParam(ADNumImages, &numImages);
+                    return captured >= numImages;
+                }
+                return false;
+            };
+
+            /* in burst mode frames wait in the pre-trigger ring instead */
+            auto deliver = [&](Frame &frame) {
+                return burst_mode ? burstFrame(frame, publish) : publish(frame);
+            };
+
+            while (true) {
+                startFrame();
+
+                if (make_frame_room()) {
+                    Frame frame = acquire_image();
+
+                    /* with accumulation, only complete groups of captures
+                     * count as frames */
+                    if (accumulate_frames <= 1) {
+                        complete = deliver(frame);
+                    } else {
+                        const bool finished = accumulateFrame(frame, accumulate_frames,
+                                                              accumulate_mode);
+                        setIntegerParam(BCAccumulateProgress, accumulation.frames);
+                        callParamCallbacks();
+                        if (finished)
+                            complete = deliver(frame);
                     }
 
-                    /* Waits until AcquirePeriod is over or stop_acquire_event is triggered.
-                     * Returns true if stop_acquire_event was triggered */
-                    if (try_wait_acquire_period(startTime)) {
+                    if (complete)
                         break;
-                    }
                 }
+
+                if (wait_frame_deadline()) {
+                    break;
+                }
+            }
+
+            /* a stopped acquisition still publishes the captures it has */
+            Frame rest;
+            if (finishAccumulation(rest, accumulate_mode)) {
+                if (complete)
+                    rest.image->release();
+                else
+                    deliver(rest);
+                setIntegerParam(BCAccumulateProgress, 0);
+            }
+        } catch (const std::runtime_error &) {
+            discardAccumulation();
+            discardBurst();
+            drain_pipeline();
+            flushDeferredROI();
+            throw;
         }
 
+        discardBurst();
+        drain_pipeline();
+        flushDeferredROI();
+
         /* Update ADStatus based on imageMode and NumImages */
         switch (imageMode) {
             case ADImageSingle:
@@ -520,95 +3256,239 @@ class epicsShareClass ADTLBC2: ADDriver, epicsThreadRunable {
         }
     }
 
-    void handle_tlbc2_err(ViStatus err, std::string function)
+    /* parameter names the setting a generic get/set was applied to */
+    void handle_tlbc2_err(ViSession vi, ViStatus err, const char *function,
+                          const char *parameter = nullptr)
     {
         asynPrint(pasynUserSelf, ASYN_TRACEIO_DRIVER,
-            "ADTLBC2: function %s returned %d\n", function.c_str(), (int)err);
+            "ADTLBC2: function %s%s%s returned %d\n", function,
+            parameter ? " " : "", parameter ? parameter : "", (int)err);
+        sdk_calls++;
         if (err == VI_SUCCESS)
             return;
 
         ViChar ebuf[TLBC2_ERR_DESCR_BUFFER_SIZE];
-        TLBC2_error_message(instr, err, ebuf);
-        throw std::runtime_error("TBLC2: " + function + ": " + std::string(ebuf));
+        TLBC2_error_message(vi, err, ebuf);
+
+        std::string message = std::string("TBLC2: ") + function;
+        if (parameter)
+            message += std::string(" ") + parameter;
+        throw std::runtime_error(message + ": " + ebuf);
     };
 
     void createParameters() {
-        createParam("AMBIENT_LIGHT_CORRECTION", asynParamInt32,
-                    &BCAmbientLightCorrection);
+        bindParam<ParamAcquireTime>(ADAcquireTime);
+        bindParam<ParamGain>(ADGain);
+        bindParam<ParamTemperature>(ADTemperatureActual);
+
+        createParam("ACCUMULATE_FRAMES", asynParamInt32, &BCAccumulateFrames);
+        createParam("ACCUMULATE_MODE", asynParamInt32, &BCAccumulateMode);
+        createParam("ACCUMULATE_PROGRESS", asynParamInt32, &BCAccumulateProgress);
 
-        auto ambient_light_correction_getter =
-            create_getter_wrapper<ViInt32, ViUInt8>(
-                TLBC2_get_ambient_light_correction_mode);
-        auto ambient_light_correction_setter =
-            create_setter_wrapper<ViInt32, ViUInt8>(
-                TLBC2_set_ambient_light_correction_mode);
-        auto ambient_light_correction_param = Parameter<ViInt32>(
-            "ambient_light_correction_mode", ambient_light_correction_getter,
-            ambient_light_correction_setter);
+        createParam("ACHIEVED_FPS", asynParamFloat64, &BCAchievedFps);
 
-        params.insert(
-            {BCAmbientLightCorrection, ambient_light_correction_param});
+        createParam("AMBIENT_LIGHT_CORRECTION", asynParamInt32,
+                    &BCAmbientLightCorrection);
+        bindParam<ParamAmbientLightCorrection>(BCAmbientLightCorrection);
 
         createParam("AMBIENT_LIGHT_CORRECTION_STATUS", asynParamInt32,
                     &BCAmbientLightCorrectionStatus);
 
         createParam("ATTENUATION", asynParamFloat64, &BCAttenuation);
-        params.insert({BCAttenuation,
-                       Parameter<ViReal64>("attenuation", TLBC2_get_attenuation,
-                                           TLBC2_set_attenuation)});
-
-        createParam("AUTO_EXPOSURE", asynParamInt32, &BCAutoExposure);
+        bindParam<ParamAttenuation>(BCAttenuation);
 
-        auto auto_exposure_getter =
-            create_getter_wrapper<ViInt32, ViBoolean>(TLBC2_get_auto_exposure);
-        auto auto_exposure_setter =
-            create_setter_wrapper<ViInt32, ViBoolean>(TLBC2_set_auto_exposure);
-        auto auto_exposure_param = Parameter<ViInt32>(
-            "auto_exposure", auto_exposure_getter, auto_exposure_setter);
+        createParam("ATTRIBUTE_SET", asynParamInt32, &BCAttributeSet);
 
-        params.insert({BCAutoExposure, auto_exposure_param});
+        createParam("AUTO_EXPOSURE", asynParamInt32, &BCAutoExposure);
+        bindParam<ParamAutoExposure>(BCAutoExposure);
 
         createParam("AUTO_CALC_AREA_CLIP_LEVEL", asynParamFloat64, &BCAutoCalcAreaClipLevel);
-        params.insert(
-            {BCAutoCalcAreaClipLevel,
-             Parameter<ViReal64>("auto_calculation_area_clip_level",
-                                 TLBC2_get_auto_calculation_area_clip_level,
-                                 TLBC2_set_auto_calculation_area_clip_level)});
+        bindParam<ParamAutoCalcAreaClipLevel>(BCAutoCalcAreaClipLevel);
+
+        createParam("AUTO_ROI", asynParamInt32, &BCAutoRoi);
+        createParam("AUTO_ROI_CHANGES", asynParamInt32, &BCAutoRoiChanges);
+        createParam("AUTO_ROI_FPS_GAIN", asynParamFloat64, &BCAutoRoiFpsGain);
+        createParam("AUTO_ROI_MARGIN", asynParamFloat64, &BCAutoRoiMargin);
+        createParam("AUTO_ROI_MAX_RATE", asynParamFloat64, &BCAutoRoiMaxRate);
+        createParam("AUTO_ROI_TIME", asynParamFloat64, &BCAutoRoiTime);
+
+        createParam("BACKGROUND_CAPTURE", asynParamInt32, &BCBackgroundCapture);
+        createParam("BACKGROUND_CLEAR", asynParamInt32, &BCBackgroundClear);
+        createParam("BACKGROUND_FILE", asynParamOctet, &BCBackgroundFile);
+        createParam("BACKGROUND_FRAMES", asynParamInt32, &BCBackgroundFrames);
+        createParam("BACKGROUND_LOAD", asynParamInt32, &BCBackgroundLoad);
+        createParam("BACKGROUND_PROGRESS", asynParamInt32, &BCBackgroundProgress);
+        createParam("BACKGROUND_REFERENCES", asynParamInt32, &BCBackgroundReferences);
+        createParam("BACKGROUND_SAVE", asynParamInt32, &BCBackgroundSave);
+        createParam("BACKGROUND_SUBTRACT", asynParamInt32, &BCBackgroundSubtract);
+        createParam("BACKGROUND_SUBTRACTED", asynParamInt32, &BCBackgroundSubtracted);
 
         createParam("BEAM_WIDTH_X", asynParamFloat64, &BCBeamWidthX);
         createParam("BEAM_WIDTH_Y", asynParamFloat64, &BCBeamWidthY);
 
+        createParam("BURST_COUNT", asynParamInt32, &BCBurstCount);
+        createParam("BURST_HELD", asynParamInt32, &BCBurstHeld);
+        createParam("BURST_MEMORY", asynParamFloat64, &BCBurstMemory);
+        createParam("BURST_MODE", asynParamInt32, &BCBurstMode);
+        createParam("BURST_POST_FRAMES", asynParamInt32, &BCBurstPostFrames);
+        createParam("BURST_PRE_FRAMES", asynParamInt32, &BCBurstPreFrames);
+        createParam("BURST_TRIGGER", asynParamInt32, &BCBurstTrigger);
+
+        createParam("CALC_DECIMATION", asynParamInt32, &BCCalcDecimation);
+        createParam("CALC_FPS", asynParamFloat64, &BCCalcFps);
+        createParam("CALC_MAX_RATE", asynParamFloat64, &BCCalcMaxRate);
+
         createParam("CENTROID_X", asynParamFloat64, &BCCentroidX);
         createParam("CENTROID_Y", asynParamFloat64, &BCCentroidY);
 
         createParam("CLIP_LEVEL", asynParamFloat64, &BCClipLevel);
-        params.insert({BCClipLevel,
-                       Parameter<ViReal64>("clip_level", TLBC2_get_clip_level,
-                                           TLBC2_set_clip_level)});
+        bindParam<ParamClipLevel>(BCClipLevel);
+
+        createParam("CODEC", asynParamInt32, &BCCodec);
+        createParam("CODEC_RATIO", asynParamFloat64, &BCCodecRatio);
+        createParam("CODEC_THROUGHPUT", asynParamFloat64, &BCCodecThroughput);
 
         createParam("COMPUTE_AMBIENT_LIGHT_CORRECTION", asynParamInt32,
                     &BCComputeAmbientLightCorrection);
 
+        createParam("EXPOSURE_CONTROL", asynParamInt32, &BCExposureControl);
+        createParam("EXPOSURE_CONVERGED", asynParamInt32, &BCExposureConverged);
+        createParam("EXPOSURE_CONVERGENCE_FRAMES", asynParamInt32, &BCExposureConvergenceFrames);
+        createParam("EXPOSURE_CONVERGENCE_TIME", asynParamFloat64, &BCExposureConvergenceTime);
+        createParam("EXPOSURE_LEVEL", asynParamFloat64, &BCExposureLevel);
+        createParam("EXPOSURE_PERCENTILE", asynParamFloat64, &BCExposurePercentile);
+        createParam("EXPOSURE_TARGET", asynParamFloat64, &BCExposureTarget);
+        createParam("EXPOSURE_TOLERANCE", asynParamFloat64, &BCExposureTolerance);
+        createParam("EXPOSURE_USE_ATTENUATION", asynParamInt32, &BCExposureUseAttenuation);
+
+        createParam("FRAME_POOL_DROPPED_NEWEST", asynParamInt32, &BCFramePoolDroppedNewest);
+        createParam("FRAME_POOL_DROPPED_OLDEST", asynParamInt32, &BCFramePoolDroppedOldest);
+        createParam("FRAME_POOL_IN_USE", asynParamInt32, &BCFramePoolInUse);
+        createParam("FRAME_POOL_MAX", asynParamInt32, &BCFramePoolHighWater);
+        createParam("FRAME_POOL_POLICY", asynParamInt32, &BCFramePoolPolicy);
+        createParam("FRAME_POOL_SIZE", asynParamInt32, &BCFramePoolSize);
+        createParam("FRAME_POOL_STALLS", asynParamInt32, &BCFramePoolStalls);
+
+        createParam("INVALID_SCANS", asynParamInt32, &BCInvalidScans);
+
+        for (int stage = 0; stage < NumStages; stage++) {
+            const std::string prefix = std::string("LATENCY_") + stage_names[stage] + "_";
+
+            createParam((prefix + "HIST").c_str(), asynParamInt32Array, &BCLatencyHistogram[stage]);
+            createParam((prefix + "MAX").c_str(), asynParamFloat64, &BCLatencyMax[stage]);
+            createParam((prefix + "P50").c_str(), asynParamFloat64, &BCLatencyP50[stage]);
+            createParam((prefix + "P99").c_str(), asynParamFloat64, &BCLatencyP99[stage]);
+        }
+        createParam("LATENCY_BUCKETS", asynParamFloat64Array, &BCLatencyBuckets);
+        createParam("LATENCY_RESET", asynParamInt32, &BCLatencyReset);
+
+        createParam("MOMENTS_DIFF_CENTROID_X", asynParamFloat64, &BCMomentsDiffCentroidX);
+        createParam("MOMENTS_DIFF_CENTROID_Y", asynParamFloat64, &BCMomentsDiffCentroidY);
+        createParam("MOMENTS_DIFF_WIDTH_X", asynParamFloat64, &BCMomentsDiffWidthX);
+        createParam("MOMENTS_DIFF_WIDTH_Y", asynParamFloat64, &BCMomentsDiffWidthY);
+        createParam("MOMENTS_SOURCE", asynParamInt32, &BCMomentsSource);
+
+        createParam("PERIOD_ACHIEVED", asynParamFloat64, &BCPeriodAchieved);
+        createParam("PERIOD_JITTER", asynParamFloat64, &BCPeriodJitter);
+        createParam("PERIOD_LATENESS_MAX", asynParamFloat64, &BCPeriodLatenessMax);
+        createParam("PERIOD_MODE", asynParamInt32, &BCPeriodMode);
+        createParam("PERIOD_OVERRUNS", asynParamInt32, &BCPeriodOverruns);
+
+        createParam("PREVIEW_BINNING", asynParamInt32, &BCPreviewBinning);
+        createParam("PREVIEW_DROPPED", asynParamInt32, &BCPreviewDropped);
+        createParam("PREVIEW_ENABLE", asynParamInt32, &BCPreviewEnable);
+        createParam("PREVIEW_MAX_RATE", asynParamFloat64, &BCPreviewMaxRate);
+        createParam("PREVIEW_MODE", asynParamInt32, &BCPreviewMode);
+
+        createParam("PROFILE_ANGLE", asynParamFloat64, &BCProfileAngle);
+        createParam("PROFILE_ENABLE", asynParamInt32, &BCProfileEnable);
+        createParam("PROFILE_ROTATE", asynParamInt32, &BCProfileRotate);
+        for (int axis = 0; axis < NumProfiles; axis++) {
+            const std::string prefix = std::string("PROFILE_") + (axis == ProfileX ? "X" : "Y");
+
+            createParam(prefix.c_str(), asynParamFloat64Array, &BCProfile[axis]);
+            createParam((prefix + "_AMPLITUDE").c_str(), asynParamFloat64, &BCProfileAmplitude[axis]);
+            createParam((prefix + "_BACKGROUND").c_str(), asynParamFloat64, &BCProfileBackground[axis]);
+            createParam((prefix + "_CENTER").c_str(), asynParamFloat64, &BCProfileCenter[axis]);
+            createParam((prefix + "_RATING").c_str(), asynParamFloat64, &BCProfileRating[axis]);
+            createParam((prefix + "_WIDTH").c_str(), asynParamFloat64, &BCProfileWidth[axis]);
+        }
+
+        createParam("PIPELINE_CAPTURE_STALLS", asynParamInt32, &BCCaptureStalls);
+        createParam("PIPELINE_PUBLISH_STALLS", asynParamInt32, &BCPublishStalls);
+        createParam("PIPELINE_QUEUE_DEPTH", asynParamInt32, &BCQueueDepth);
+        createParam("PIPELINE_QUEUE_MAX", asynParamInt32, &BCQueueHighWater);
+
+        createParam("RAW_MODE", asynParamInt32, &BCRawMode);
+
+        createParam("ROI_APPLY", asynParamInt32, &BCRoiApply);
+        createParam("ROI_APPLY_LATENCY", asynParamFloat64, &BCRoiApplyLatency);
+        createParam("ROI_COALESCE_TIME", asynParamFloat64, &BCRoiCoalesceTime);
+        createParam("ROI_COMMIT", asynParamInt32, &BCRoiCommit);
+        createParam("ROI_PENDING", asynParamInt32, &BCRoiPending);
+
+        createParam("RESULTS_CENTROID_X", asynParamFloat64Array, &BCResults[ResultCentroidX]);
+        createParam("RESULTS_CENTROID_Y", asynParamFloat64Array, &BCResults[ResultCentroidY]);
+        createParam("RESULTS_COUNT", asynParamInt32, &BCResultsCount);
+        createParam("RESULTS_FRAME", asynParamInt32Array, &BCResultsFrame);
+        createParam("RESULTS_ONLY", asynParamInt32, &BCResultsOnly);
+        createParam("RESULTS_OVERRUNS", asynParamInt32, &BCResultsOverruns);
+        createParam("RESULTS_PERIOD", asynParamFloat64, &BCResultsPeriod);
+        createParam("RESULTS_POWER", asynParamFloat64Array, &BCResults[ResultPower]);
+        createParam("RESULTS_SATURATION", asynParamFloat64Array, &BCResults[ResultSaturation]);
+        createParam("RESULTS_TIMESTAMP", asynParamFloat64Array, &BCResults[ResultTimestamp]);
+        createParam("RESULTS_WIDTH_X", asynParamFloat64Array, &BCResults[ResultWidthX]);
+        createParam("RESULTS_WIDTH_Y", asynParamFloat64Array, &BCResults[ResultWidthY]);
+
         createParam("SATURATION", asynParamFloat64, &BCSaturation);
 
+        static const char *const stability_names[] = {
+            "CENTROID_X", "CENTROID_Y", "WIDTH_X", "WIDTH_Y",
+        };
+        static const char *const stability_stats[] = {
+            "MEAN", "RMS", "MIN", "MAX", "P2P",
+        };
+        static_assert(std::size(stability_names) == num_stability_channels);
+        static_assert(std::size(stability_stats) == NumStabilityStats);
+
+        for (int c = 0; c < num_stability_channels; c++) {
+            const std::string prefix = std::string("STABILITY_") + stability_names[c] + "_";
+
+            createParam((prefix + "ADEV").c_str(), asynParamFloat64Array, &BCStabilityAdev[c]);
+            for (int i = 0; i < NumStabilityStats; i++)
+                createParam((prefix + stability_stats[i]).c_str(), asynParamFloat64,
+                            &BCStability[c][i]);
+        }
+        createParam("STABILITY_RESET", asynParamInt32, &BCStabilityReset);
+        createParam("STABILITY_SAMPLES", asynParamInt32, &BCStabilitySamples);
+        createParam("STABILITY_TAU", asynParamFloat64Array, &BCStabilityTau);
+        createParam("STABILITY_WINDOW", asynParamInt32, &BCStabilityWindow);
+
+        createParam("CACHE_HITS", asynParamInt32, &BCCacheHits);
+        createParam("CACHE_MAX_AGE", asynParamFloat64, &BCCacheMaxAge);
+        createParam("CACHE_MISSES", asynParamInt32, &BCCacheMisses);
+        createParam("SDK_CALLS", asynParamInt32, &BCSdkCalls);
+
+        createParam("SCHED_WAIT_CONTROL", asynParamFloat64, &BCSchedWait[DeviceScheduler::Control]);
+        createParam("SCHED_WAIT_ACQUISITION", asynParamFloat64, &BCSchedWait[DeviceScheduler::Acquisition]);
+        createParam("SCHED_WAIT_HOUSEKEEPING", asynParamFloat64, &BCSchedWait[DeviceScheduler::Housekeeping]);
+        createParam("SCHED_WAIT_MAX_CONTROL", asynParamFloat64, &BCSchedWaitMax[DeviceScheduler::Control]);
+        createParam("SCHED_WAIT_MAX_ACQUISITION", asynParamFloat64, &BCSchedWaitMax[DeviceScheduler::Acquisition]);
+        createParam("SCHED_WAIT_MAX_HOUSEKEEPING", asynParamFloat64, &BCSchedWaitMax[DeviceScheduler::Housekeeping]);
+        createParam("SCHED_WAIT_RESET", asynParamInt32, &BCSchedWaitReset);
+
         createParam("WAVELENGTH", asynParamFloat64, &BCWavelength);
-        params.insert({BCWavelength,
-                       Parameter<ViReal64>("wavelength", TLBC2_get_wavelength,
-                                           TLBC2_set_wavelength,
-                                           TLBC2_get_wavelength_range)});
+        bindParam<ParamWavelength>(BCWavelength);
     }
 
     void readParameters() {
-        for (auto &[id, param] : params) {
+        forEachParam([&](auto &param) {
             try {
-                if (std::holds_alternative<Parameter<ViInt32>>(param))
-                    readbackParam<ViInt32>(id, std::get<Parameter<ViInt32>>(param));
-                else
-                    readbackParam<ViReal64>(id, std::get<Parameter<ViReal64>>(param));
+                readbackParam(param);
             } catch (std::runtime_error &err) {
                 std::cerr << err.what() << std::endl;
             }
-        }
+        });
 
         try {
             ViUInt16 left, top, width, height;
@@ -617,8 +3497,9 @@ class epicsShareClass ADTLBC2: ADDriver, epicsThreadRunable {
              * values from the previously configured ROI, the X values are reset
              * to 0 and MaxX. This means that users who wish to keep these
              * values in sync must rely on autosave. */
-            handle_tlbc2_err(TLBC2_get_roi(instr, &left, &top, &width, &height),
-                             "get_roi");
+            device.execute(DeviceScheduler::Housekeeping, [&](ViSession vi) {
+                get_roi(vi, left, top, width, height);
+            });
 
             setIntegerParam(ADMinX, left);
             setIntegerParam(ADMinY, top);
@@ -641,24 +3522,16 @@ class epicsShareClass ADTLBC2: ADDriver, epicsThreadRunable {
         setIntegerParam(NDArrayCounter, total_images + 1);
     }
 
-    void readAcquireTime() {
-        int auto_exposure;
-        getIntegerParam(BCAutoExposure, &auto_exposure);
-
-        if (auto_exposure) {
-            try {
-                ViReal64 exposure_time;
-                auto param = std::get<Parameter<ViReal64>>(
-                    params.find(ADAcquireTime)->second);
-
-                handle_tlbc2_err(param.get(instr, exposure_time),
-                                 "get_" + param.name);
+    /* Called by the capture thread from within its device command. Failures
+     * are only reported, since the frame itself is still good */
+    void readAcquireTime(ViSession vi, ViReal64 &exposure_time) {
+        try {
+            auto &param = std::get<ParamAcquireTime>(params);
 
-                setDoubleParam(ADAcquireTime, exposure_time);
-            } catch (const std::runtime_error &err) {
-                asynPrint(pasynUserSelf, ASYN_TRACE_ERROR, "%s\n", err.what());
-                setStringParam(ADStatusMessage, err.what());
-            }
+            handle_tlbc2_err(vi, param.get(vi, exposure_time), "get", param.name);
+        } catch (const std::runtime_error &err) {
+            exposure_time = -1;
+            asynPrint(pasynUserSelf, ASYN_TRACE_ERROR, "%s\n", err.what());
         }
     }
 
@@ -669,206 +3542,157 @@ class epicsShareClass ADTLBC2: ADDriver, epicsThreadRunable {
         setDoubleParam(BCCentroidX, data.centroidPositionX);
         setDoubleParam(BCCentroidY, data.centroidPositionY);
         setDoubleParam(BCSaturation, data.saturation);
+
+        /* the sensor temperature comes with every frame for free */
+        setDoubleParam(ADTemperatureActual, data.temperature);
+        std::get<ParamTemperature>(params).store(data.temperature);
+    }
+
+    void updateParamsWithMoments(const BeamMoments &moments)
+    {
+        if (!moments.valid)
+            return;
+
+        setDoubleParam(BCBeamWidthX, moments.width_x);
+        setDoubleParam(BCBeamWidthY, moments.width_y);
+        setDoubleParam(BCCentroidX, moments.centroid_x);
+        setDoubleParam(BCCentroidY, moments.centroid_y);
+    }
+
+    /* Driver minus SDK results, for checking one against the other */
+    void updateMomentsDifference(const BeamMoments &moments, const TLBC1_Calculations &data)
+    {
+        if (!moments.valid)
+            return;
+
+        setDoubleParam(BCMomentsDiffCentroidX, moments.centroid_x - data.centroidPositionX);
+        setDoubleParam(BCMomentsDiffCentroidY, moments.centroid_y - data.centroidPositionY);
+        setDoubleParam(BCMomentsDiffWidthX, moments.width_x - data.beamWidthIsoX);
+        setDoubleParam(BCMomentsDiffWidthY, moments.width_y - data.beamWidthIsoY);
+    }
+
+    /* Rebuilds the attributes attached to each frame */
+    void selectAttributes(int set)
+    {
+        frame_attributes.select(attribute_set_groups[set]);
     }
 
     void addAttributesFromScan(NDArray* image, TLBC1_Calculations &data) {
-        auto list = image->pAttributeList;
-
-        list->add("BaseLevel", "Mean noise of the sensor", NDAttrFloat64,
-                  &data.baseLevel);
-        list->add("LightShieldedPixelMeanIntensity",
-                  "Mean intensity of the light shielded pixels", NDAttrFloat64,
-                  &data.lightShieldedPixelMeanIntensity);
-        list->add("Saturation",
-                  "Ratio of the highest intensity in the scan to the dynamic range of the sensor",
-                  NDAttrFloat64, &data.saturation);
-        list->add("PeakPositionX", "Peak x pixel position", NDAttrUInt16,
-                  &data.peakPositionX);
-        list->add("PeakPositionY", "Peak y pixel position", NDAttrUInt16,
-                  &data.peakPositionY);
-        list->add("CentroidPositionX", "Centroid x pixel position",
-                  NDAttrFloat32, &data.centroidPositionX);
-        list->add("CentroidPositionY", "Centroid y pixel position",
-                  NDAttrFloat32, &data.centroidPositionY);
-
-        list->add("BeamWidthIsoX", "Beam width in X axis (ISO 11146-2)",
-                  NDAttrFloat64, &data.beamWidthIsoX);
-        list->add("BeamWidthIsoY", "Beam width in Y axis (ISO 11146-2)",
-                  NDAttrFloat64, &data.beamWidthIsoY);
-        list->add("BeamWidthIsoXSimple",
-                  "Beam width in X axis for round profiles with "
-                  "ellipticity > 87% (ISO 11146-2)",
-                  NDAttrFloat64, &data.beamWidthIsoXSimple);
-        list->add("BeamWidthIsoYSimple",
-                  "Beam width in Y axis for round profiles with "
-                  "ellipticity > 87% (ISO 11146-2)",
-                  NDAttrFloat64, &data.beamWidthIsoYSimple);
-        list->add("BeamWidthClipX",
-                  "Horizontal beam width at clip level in pixel", NDAttrFloat32,
-                  &data.beamWidthClipX);
-        list->add("BeamWidthClipY",
-                  "Vertical beam width at clip level in pixel", NDAttrFloat32,
-                  &data.beamWidthClipY);
-        list->add("EllipticityIso",
-                  "Ellipticity of the beam width (ISO 11146-2)", NDAttrFloat64,
-                  &data.ellipticityIso);
-        list->add("AzimuthAngle",
-                  "Azimuth angle measured clockwise (ISO 11146-2)",
-                  NDAttrFloat64, &data.azimuthAngle);
-
-        list->add("EllipseDiameterMin",
-                  "Ellipse minor axis diameter in [pixel]", NDAttrFloat32,
-                  &data.ellipseDiaMin);
-        list->add("EllipseDiameterMax",
-                  "Ellipse major axis diameter in [pixel]", NDAttrFloat32,
-                  &data.ellipseDiaMax);
-        list->add("EllipseDiameterMean",
-                  "Ellipse diameter arithmetic mean value in [pixel]",
-                  NDAttrFloat32, &data.ellipseDiaMean);
-        list->add("EllipseOrientation", "Ellipse orientation angle in degree.",
-                  NDAttrFloat32, &data.ellipseOrientation);
-        list->add("EllipseEllipticity",
-                  "Ellipse's ratio of minor to major axis diameter",
-                  NDAttrFloat32, &data.ellipseEllipticity);
-        list->add("EllipseEccentricity", "Ellipse's eccentricity",
-                  NDAttrFloat32, &data.ellipseEccentricity);
-        list->add("EllipseCenterX", "Ellipse center x pixel position",
-                  NDAttrFloat32, &data.ellipseCenterX);
-        list->add("EllipseCenterY", "Ellipse center y pixel position",
-                  NDAttrFloat32, &data.ellipseCenterY);
-        list->add("EllipseFitAmplitude",
-                  "Ellipse amplitude in Fourier fit (in pixel)", NDAttrFloat32,
-                  &data.ellipseFitAmplitude);
-        list->add("EllipseRotAngleX", "Ellipse rotation angle in x",
-                  NDAttrFloat32, &data.rotAngleEllipseX);
-        list->add("EllipseRotAngleY", "Ellipse rotation angle in y",
-                  NDAttrFloat32, &data.rotAngleEllipseY);
-        list->add("EllipseWidthIsoX", "Ellipse width in x", NDAttrFloat32,
-                  &data.ellipseWidthIsoX);
-        list->add("EllipseWidthIsoY", "Ellipse width in y", NDAttrFloat32,
-                  &data.ellipseWidthIsoY);
-
-        list->add("TotalPower", "Total power in dBm", NDAttrFloat32,
-                  &data.totalPower);
-        list->add("PeakPowerDensity", "Peak power density in mW/um^2",
-                  NDAttrFloat32, &data.peakPowerDensity);
-
-        list->add("GaussianFitCentroidPositionX",
-                  "Centroid x pixel position for the gaussian profile",
-                  NDAttrFloat32, &data.gaussianFitCentroidPositionX);
-        list->add("GaussianFitCentroidPositionY",
-                  "Centroid y pixel position for the gaussian profile",
-                  NDAttrFloat32, &data.gaussianFitCentroidPositionY);
-        list->add("GaussianFitRatingX",
-                  "Ratio of actual data to the gaussian fit of the x profile",
-                  NDAttrFloat32, &data.gaussianFitRatingX);
-        list->add("GaussianFitRatingY",
-                  "Ratio of actual data to the gaussian fit of the y profile",
-                  NDAttrFloat32, &data.gaussianFitRatingY);
-        list->add("GaussianFitDiameterX", "Diameter for the profile X centroid",
-                  NDAttrFloat32, &data.gaussianFitDiameterX);
-        list->add("GaussianFitDiameterY", "Diameter for the profile Y centroid",
-                  NDAttrFloat32, &data.gaussianFitDiameterY);
-
-        list->add("CalcAreaCenterX", "Calculation area left border",
-                  NDAttrFloat32, &data.calcAreaCenterX);
-        list->add("CalcAreaCenterY", "Calculation area right border",
-                  NDAttrFloat32, &data.calcAreaCenterY);
-        list->add("CalcAreaWidth", "Calculation area width", NDAttrFloat32,
-                  &data.calcAreaWidth);
-        list->add("CalcAreaHeight", "Calculation area height", NDAttrFloat32,
-                  &data.calcAreaHeight);
-        list->add("CalcAreaAngle",
-                  "Calculation area angle in degree (counterclock)",
-                  NDAttrFloat64, &data.calcAreaAngle);
-        list->add("CalcAreaLineOffset",
-                  "Pixel inside the calculation area per line", NDAttrFloat64,
-                  &data.calcAreaLineOffset);
-
-        list->add("ProfilePeakValueX",
-                  "Peak intensity value in the x profile (in calc area)",
-                  NDAttrFloat32, &data.profilePeakValueX);
-        list->add("ProfilePeakValueY",
-                  "Peak intensity value in the y profile (in calc area)",
-                  NDAttrFloat32, &data.profilePeakValueY);
-        list->add(
-            "ProfilePeakPosX",
-            "Intensity profile peak intensity x pixel position (in calc area)",
-            NDAttrUInt16, &data.profilePeakPosX);
-        list->add(
-            "ProfilePeakPosY",
-            "Intensity profile peak intensity y pixel position (in calc area)",
-            NDAttrUInt16, &data.profilePeakPosY);
-
-        list->add(
-            "EffectiveArea",
-            "Area of an ideal flat top beam with same peak intensity in um^2",
-            NDAttrFloat64, &data.effectiveArea);
-        list->add("EffectiveBeamDiameter", "Effective beam diameter",
-                  NDAttrFloat64, &data.effectiveBeamDiameter);
-
-        list->add("Temperature", "Temperature", NDAttrFloat64,
-                  &data.temperature);
-
-        list->add("BesselFitRatingX", "Bessel fit rating in x profile",
-                  NDAttrFloat32, &data.besselFitRatingX);
-        list->add("BesselFitRatingY", "Bessel fit rating in y profile",
-                  NDAttrFloat32, &data.besselFitRatingY);
+        frame_attributes.attachScan(image, data);
+    }
+
+    void addAttributesFromMoments(NDArray* image, BeamMoments &moments) {
+        if (moments.valid)
+            frame_attributes.attachMoments(image, moments);
+        else
+            frame_attributes.detach(image);
     }
 
 public:
-    ADTLBC2(const char *portName, int maxSizeX, int maxSizeY, int maxMemory, int reset):
-        ADDriver(portName, 1, 0, 0, maxMemory,
-                 0, 0,
-                 ASYN_CANBLOCK, 1,
+    static constexpr const char *stage_names[] = {
+        "REQUEST", "SCAN_DATA", "ALLOC", "GET_IMAGE", "COPY", "BACKGROUND",
+        "MOMENTS", "CAPTURE", "ACCUMULATE", "QUEUE", "PROFILES",
+        "ATTRIBUTES", "CODEC", "CALLBACKS", "PERIOD_WAIT", "LOCK_WAIT",
+    };
+    static_assert(std::size(stage_names) == NumStages);
+
+    void resetLatency()
+    {
+        for (auto &histogram : latency)
+            histogram.reset();
+    }
+
+    /* Prints p50, p99 and max of every stage, in microseconds */
+    void latencyReport(FILE *fp)
+    {
+        fprintf(fp, "%-12s %10s %10s %10s %10s\n", "stage", "count", "p50", "p99", "max");
+
+        for (int stage = 0; stage < NumStages; stage++) {
+            auto summary = latency[stage].summary();
+
+            fprintf(fp, "%-12s %10llu %10.0f %10.0f %10.0f\n", stage_names[stage],
+                    (unsigned long long)summary.count, summary.p50, summary.p99,
+                    summary.max);
+        }
+    }
+
+    void report(FILE *fp, int details) override
+    {
+        ADDriver::report(fp, details);
+
+        if (details > 0) {
+            fprintf(fp, "  Acquisition latency (us):\n");
+            latencyReport(fp);
+        }
+    }
+
+    /* Frames published since the IOC started or NDArrayCounter was reset */
+    int publishedFrames()
+    {
+        int frames = 0;
+
+        lock();
+        getIntegerParam(NDArrayCounter, &frames);
+        unlock();
+        return frames;
+    }
+
+    /* selector is the serial number or resource name of the profiler to
+     * open, empty or NULL for the first one not used by another port */
+    ADTLBC2(const char *portName, int maxSizeX, int maxSizeY, int maxMemory, int reset,
+            const char *selector):
+        /* address 0 carries the full frames, address 1 the binned preview */
+        ADDriver(portName, 2, 0, 0, maxMemory,
+                 asynInt32ArrayMask | asynFloat64ArrayMask,
+                 asynInt32ArrayMask | asynFloat64ArrayMask,
+                 ASYN_CANBLOCK | ASYN_MULTIDEVICE, 1,
                  -1, -1),
         acq_thread(*this, (std::string(portName) + "-acq").c_str(), epicsThreadGetStackSize(epicsThreadStackMedium), epicsThreadPriorityHigh),
-        params({
-            {ADAcquireTime, Parameter<ViReal64>("exposure_time", TLBC2_get_exposure_time, TLBC2_set_exposure_time, TLBC2_get_exposure_time_range)},
-            {ADGain, Parameter<ViReal64>("gain", TLBC2_get_gain, TLBC2_set_gain, TLBC2_get_gain_range)},
-            {ADTemperatureActual, Parameter<ViReal64>("temperature", TLBC2_get_temperature, {})}
-        })
+        frame_queue(frame_queue_size, sizeof(Frame)),
+        frame_pool(this),
+        publisher(*this),
+        publish_thread(publisher, (std::string(portName) + "-pub").c_str(), epicsThreadGetStackSize(epicsThreadStackMedium), epicsThreadPriorityHigh),
+        results_streamer(*this),
+        results_thread(results_streamer, (std::string(portName) + "-results").c_str(), epicsThreadGetStackSize(epicsThreadStackMedium), epicsThreadPriorityMedium),
+        previewer(*this),
+        preview_thread(previewer, (std::string(portName) + "-preview").c_str(), epicsThreadGetStackSize(epicsThreadStackMedium), epicsThreadPriorityMedium),
+        workers(std::string(portName) + "-calc", std::min((unsigned)epicsThreadGetCPUs(), max_workers)),
+        publish_workers(std::string(portName) + "-publish",
+                        std::min((unsigned)epicsThreadGetCPUs(), max_workers)),
+        operations(std::string(portName) + "-ops"),
+        roi_timer_notify(*this),
+        timer_queue(epicsTimerQueueActive::allocate(false, epicsThreadPriorityMedium)),
+        roi_timer(timer_queue.createTimer())
     {
+        std::fill(std::begin(param_index), std::end(param_index), -1);
+
         setIntegerParam(ADStatus, ADStatusInitializing);
         callParamCallbacks();
 
-        ViUInt32 device_count = 0;
-        handle_tlbc2_err(TLBC2_get_device_count(VI_NULL, &device_count),
-                         "get_device_count");
-
-        if (device_count < 1)
-            throw std::runtime_error("no available devices");
-
-        ViBoolean available;
-        ViChar resource_name[256];
-        ViChar manufacturer[64];
-        ViChar model_name[64];
-        ViChar serial_number[64];
-
-        /* XXX: we always use the first available device */
-        handle_tlbc2_err(
-            TLBC2_get_device_information(VI_NULL,       /* vi */
-                                         0,             /* device index */
-                                         manufacturer,
-                                         model_name,
-                                         serial_number,
-                                         &available, resource_name),
-            "get_device_information");
-
-        setStringParam(ADManufacturer, manufacturer);
-        setStringParam(ADModel, model_name);
-        setStringParam(ADSerialNumber, serial_number);
-
-        handle_tlbc2_err(TLBC2_init(resource_name,
+        auto info = device_directory.claim(selector, portName,
+            [this](ViStatus err, const char *function) {
+                handle_tlbc2_err(VI_NULL, err, function);
+            });
+
+        setStringParam(ADManufacturer, info.manufacturer.c_str());
+        setStringParam(ADModel, info.model_name.c_str());
+        setStringParam(ADSerialNumber, info.serial_number.c_str());
+
+        ViSession instr = TLBC2_INV_DEVICE_HANDLE;
+
+        handle_tlbc2_err(VI_NULL,
+                         TLBC2_init((ViRsrc)info.resource_name.c_str(),
                                     VI_TRUE, /* identification query */
                                     reset ? VI_TRUE : VI_FALSE, /* reset device */
                                     &instr),
                          "init");
 
+        device.attach(instr);
+
         ViChar sdk_version[256];
         ViChar firmware_version[256];
 
-        handle_tlbc2_err(
+        handle_tlbc2_err(instr,
             TLBC2_revision_query(instr, sdk_version, firmware_version),
             "Get firmware and SDK version");
 
@@ -879,11 +3703,52 @@ public:
 
         setIntegerParam(ADMaxSizeX, maxSizeX);
         setIntegerParam(ADMaxSizeY, maxSizeY);
-        setIntegerParam(BCAmbientLightCorrectionStatus, 0);
+        ViUInt8 ambient_status;
+        handle_tlbc2_err(instr,
+            TLBC2_get_ambient_light_correction_status(instr, &ambient_status),
+            "get_ambient_light_correction_status");
+        setIntegerParam(BCAmbientLightCorrectionStatus, ambientStatus(ambient_status));
+        setDoubleParam(BCCacheMaxAge, 1.0);
+        setIntegerParam(BCAttributeSet, AttributeSetAll);
+        setIntegerParam(BCMomentsSource, MomentsSDK);
+        setIntegerParam(BCCalcDecimation, 1);
+        setIntegerParam(BCPreviewBinning, 4);
+        setIntegerParam(BCPreviewMode, PreviewMean);
+        setDoubleParam(BCPreviewMaxRate, 5.0);
+        setIntegerParam(BCProfileEnable, 0);
+        setIntegerParam(BCProfileRotate, 0);
+        setDoubleParam(BCResultsPeriod, 0.5);
+        setDoubleParam(BCAutoRoiMargin, 3.0);
+        setDoubleParam(BCAutoRoiMaxRate, 2.0);
+        setDoubleParam(BCAutoRoiFpsGain, 1.0);
+        setIntegerParam(BCRoiCommit, RoiCommitCoalesce);
+        setDoubleParam(BCRoiCoalesceTime, 0.1);
+        setDoubleParam(BCExposureTarget, 0.7);
+        setDoubleParam(BCExposurePercentile, 99.99);
+        setDoubleParam(BCExposureTolerance, 0.1);
+        setIntegerParam(BCExposureUseAttenuation, 1);
+        setIntegerParam(BCPeriodMode, PeriodAcquirePeriod);
+        setIntegerParam(BCCodec, CodecNone);
+        setIntegerParam(BCFramePoolSize, default_frame_pool_size);
+        setIntegerParam(BCFramePoolPolicy, PoolBlock);
+        setIntegerParam(BCBackgroundFrames, 16);
+        setIntegerParam(BCAccumulateFrames, 1);
+        setIntegerParam(BCAccumulateMode, AccumulateMean);
+        setIntegerParam(BCBurstPreFrames, 8);
+        setIntegerParam(BCBurstPostFrames, 8);
+        setIntegerParam(BCBackgroundReferences, 0);
+        setStringParam(BCBackgroundFile, "");
+        selectAttributes(AttributeSetAll);
 
         readParameters();
 
+        publish_thread.start();
+        preview_thread.start();
+        results_thread.start();
         acq_thread.start();
+
+        epicsGuard<epicsMutex> guard(drivers_lock);
+        port_drivers[portName] = this;
     }
 };
 
@@ -892,18 +3757,105 @@ static const iocshArg arg1 = {"maxX", iocshArgInt};
 static const iocshArg arg2 = {"maxY", iocshArgInt};
 static const iocshArg arg3 = {"maxMemory", iocshArgInt};
 static const iocshArg arg4 = {"reset", iocshArgInt};
+static const iocshArg arg5 = {"device", iocshArgString};
 
-static const iocshArg *const args[] = {&arg0, &arg1, &arg2, &arg3, &arg4};
+static const iocshArg *const args[] = {&arg0, &arg1, &arg2, &arg3, &arg4, &arg5};
 
-static const iocshFuncDef configTLBC2 = {"TLBC2Config", 5, args};
+static const iocshFuncDef configTLBC2 = {"TLBC2Config", 6, args};
 static void configTLBC2CallFunc(const iocshArgBuf *args)
 {
-    new ADTLBC2(args[0].sval, args[1].ival, args[2].ival, args[3].ival, args[4].ival);
+    new ADTLBC2(args[0].sval, args[1].ival, args[2].ival, args[3].ival, args[4].ival,
+                args[5].sval);
+}
+
+static const iocshArg latencyArg0 = {"portName", iocshArgString};
+static const iocshArg latencyArg1 = {"reset", iocshArgInt};
+
+static const iocshArg *const latencyArgs[] = {&latencyArg0, &latencyArg1};
+
+static const iocshFuncDef latencyTLBC2 = {"TLBC2LatencyReport", 2, latencyArgs};
+static void latencyTLBC2CallFunc(const iocshArgBuf *args)
+{
+    auto driver = findTLBC2(args[0].sval);
+
+    if (!driver) {
+        fprintf(stderr, "TLBC2LatencyReport: no TLBC2 port named %s\n",
+                args[0].sval ? args[0].sval : "");
+        return;
+    }
+
+    driver->latencyReport(stdout);
+    if (args[1].ival)
+        driver->resetLatency();
+}
+
+/* User plus system CPU time of the IOC process, in seconds */
+static double processCpuTime()
+{
+#ifdef _WIN32
+    FILETIME creation, exit, kernel, user;
+    GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user);
+
+    auto seconds = [](const FILETIME &time) {
+        return (((epicsUInt64)time.dwHighDateTime << 32) | time.dwLowDateTime) * 1e-7;
+    };
+    return seconds(kernel) + seconds(user);
+#else
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec +
+           (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) * 1e-6;
+#endif
+}
+
+static const iocshArg benchmarkArg0 = {"seconds", iocshArgDouble};
+
+static const iocshArg *const benchmarkArgs[] = {&benchmarkArg0};
+
+static const iocshFuncDef benchmarkTLBC2 = {"TLBC2Benchmark", 1, benchmarkArgs};
+static void benchmarkTLBC2CallFunc(const iocshArgBuf *args)
+{
+    const double seconds = args[0].dval > 0 ? args[0].dval : 10.;
+
+    std::vector<std::pair<std::string, ADTLBC2 *>> drivers;
+    for (const auto &port : device_directory.ports()) {
+        auto driver = findTLBC2(port.c_str());
+        if (driver)
+            drivers.emplace_back(port, driver);
+    }
+
+    std::vector<int> start_frames;
+    for (const auto &driver : drivers)
+        start_frames.push_back(driver.second->publishedFrames());
+
+    const epicsUInt64 start = epicsMonotonicGet();
+    const double start_cpu = processCpuTime();
+    epicsThreadSleep(seconds);
+    const double elapsed = (epicsMonotonicGet() - start) * 1e-9;
+    const double cpu = processCpuTime() - start_cpu;
+
+    double total_fps = 0;
+    printf("%-16s %10s %10s\n", "port", "frames", "fps");
+    for (size_t i = 0; i < drivers.size(); i++) {
+        const int frames = drivers[i].second->publishedFrames() - start_frames[i];
+
+        total_fps += frames / elapsed;
+        printf("%-16s %10d %10.1f\n", drivers[i].first.c_str(), frames, frames / elapsed);
+    }
+    printf("%-16s %10s %10.1f\n", "total", "", total_fps);
+    printf("CPU: %.1f%% of one core, %.1f%% of %u cores\n", 100 * cpu / elapsed,
+           100 * cpu / elapsed / epicsThreadGetCPUs(), (unsigned)epicsThreadGetCPUs());
 }
 
 static void TLBC2Register()
 {
     iocshRegister(&configTLBC2, configTLBC2CallFunc);
+    iocshRegister(&latencyTLBC2, latencyTLBC2CallFunc);
+    iocshRegister(&benchmarkTLBC2, benchmarkTLBC2CallFunc);
+#ifdef TLBC2_SIM
+    TLBC2SimRegister();
+#endif
 }
 
 extern "C" {
@@ -0,0 +1,77 @@
+#include <algorithm>
+
+#include "TLBC2Accumulate.h"
+#include "TLBC2Workers.h"
+
+namespace {
+
+/* Pixels per chunk, so that waking up a worker is worth it */
+constexpr size_t min_pixels_per_chunk = 64 * 1024;
+
+/* Plain element-wise loops without branches, so the compiler vectorizes
+ * them. The division by a loop invariant becomes a multiplication */
+template<typename T>
+void start(WorkerPool &pool, const T *frame, size_t pixels, epicsUInt32 *sum)
+{
+    pool.parallel_for(pixels, min_pixels_per_chunk, [&](size_t, size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++)
+            sum[i] = frame[i];
+    });
+}
+
+template<typename T>
+void accumulate(WorkerPool &pool, const T *frame, size_t pixels, epicsUInt32 *sum)
+{
+    pool.parallel_for(pixels, min_pixels_per_chunk, [&](size_t, size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++)
+            sum[i] += frame[i];
+    });
+}
+
+template<typename T>
+void average(WorkerPool &pool, const epicsUInt32 *sum, size_t pixels, unsigned frames, T *out)
+{
+    frames = std::max(frames, 1u);
+    const epicsUInt32 half = frames / 2;
+
+    pool.parallel_for(pixels, min_pixels_per_chunk, [&](size_t, size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++)
+            out[i] = (T)((sum[i] + half) / frames);
+    });
+}
+
+} // namespace
+
+void start_sum(WorkerPool &pool, const epicsUInt8 *frame, size_t pixels, epicsUInt32 *sum)
+{
+    start(pool, frame, pixels, sum);
+}
+
+void start_sum(WorkerPool &pool, const epicsUInt16 *frame, size_t pixels, epicsUInt32 *sum)
+{
+    start(pool, frame, pixels, sum);
+}
+
+void accumulate_frame(WorkerPool &pool, const epicsUInt8 *frame, size_t pixels,
+                      epicsUInt32 *sum)
+{
+    accumulate(pool, frame, pixels, sum);
+}
+
+void accumulate_frame(WorkerPool &pool, const epicsUInt16 *frame, size_t pixels,
+                      epicsUInt32 *sum)
+{
+    accumulate(pool, frame, pixels, sum);
+}
+
+void average_frame(WorkerPool &pool, const epicsUInt32 *sum, size_t pixels,
+                   unsigned frames, epicsUInt8 *out)
+{
+    average(pool, sum, pixels, frames, out);
+}
+
+void average_frame(WorkerPool &pool, const epicsUInt32 *sum, size_t pixels,
+                   unsigned frames, epicsUInt16 *out)
+{
+    average(pool, sum, pixels, frames, out);
+}
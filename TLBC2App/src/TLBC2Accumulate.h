@@ -0,0 +1,27 @@
+#ifndef TLBC2ACCUMULATE_H
+#define TLBC2ACCUMULATE_H
+
+#include <cstddef>
+
+#include <epicsTypes.h>
+
+class WorkerPool;
+
+/* Copies the pixel values of the first of several frames into sum, widening
+ * them, splitting the frame over the pool */
+void start_sum(WorkerPool &pool, const epicsUInt8 *frame, size_t pixels, epicsUInt32 *sum);
+void start_sum(WorkerPool &pool, const epicsUInt16 *frame, size_t pixels, epicsUInt32 *sum);
+
+/* Adds the pixel values of a frame to sum */
+void accumulate_frame(WorkerPool &pool, const epicsUInt8 *frame, size_t pixels,
+                      epicsUInt32 *sum);
+void accumulate_frame(WorkerPool &pool, const epicsUInt16 *frame, size_t pixels,
+                      epicsUInt32 *sum);
+
+/* Writes the rounded means of the sums of frames frames to out */
+void average_frame(WorkerPool &pool, const epicsUInt32 *sum, size_t pixels,
+                   unsigned frames, epicsUInt8 *out);
+void average_frame(WorkerPool &pool, const epicsUInt32 *sum, size_t pixels,
+                   unsigned frames, epicsUInt16 *out);
+
+#endif /* TLBC2ACCUMULATE_H */
@@ -0,0 +1,299 @@
+#ifndef TLBC2ATTRIBUTES_H
+#define TLBC2ATTRIBUTES_H
+
+#include <cstddef>
+#include <map>
+#include <vector>
+
+#include <NDArray.h>
+#include <NDAttribute.h>
+
+#include <TLBC1_Calculations.h>
+
+#include "TLBC2Moments.h"
+
+/* Groups of scan results that are attached to each frame as attributes */
+enum AttributeGroup {
+    AttrPosition    = 1 << 0,   /* peak and centroid */
+    AttrIsoWidths   = 1 << 1,   /* ISO 11146-2 widths, ellipticity, azimuth */
+    AttrClipWidths  = 1 << 2,
+    AttrEllipse     = 1 << 3,
+    AttrPower       = 1 << 4,
+    AttrFits        = 1 << 5,   /* gaussian and bessel fits */
+    AttrCalcArea    = 1 << 6,
+    AttrProfile     = 1 << 7,
+    AttrSensor      = 1 << 8,   /* base level, saturation, temperature */
+    AttrAll         = (1 << 9) - 1
+};
+
+/* Values of the ATTRIBUTE_SET parameter */
+enum AttributeSet {
+    AttributeSetNone,
+    AttributeSetPosition,
+    AttributeSetIsoWidths,
+    AttributeSetAll,
+    NumAttributeSets
+};
+
+constexpr unsigned attribute_set_groups[NumAttributeSets] = {
+    0,
+    AttrPosition,
+    AttrPosition | AttrIsoWidths,
+    AttrAll,
+};
+
+/* A TLBC1_Calculations field exported as an NDAttribute */
+struct ScanAttribute {
+    const char *name;
+    const char *description;
+    NDAttrDataType_t type;
+    size_t offset;
+    unsigned group;
+};
+
+constexpr ScanAttribute scan_attributes[] = {
+    {"BaseLevel", "Mean noise of the sensor",
+     NDAttrFloat64, offsetof(TLBC1_Calculations, baseLevel), AttrSensor},
+    {"LightShieldedPixelMeanIntensity", "Mean intensity of the light shielded pixels",
+     NDAttrFloat64, offsetof(TLBC1_Calculations, lightShieldedPixelMeanIntensity), AttrSensor},
+    {"Saturation", "Ratio of the highest intensity in the scan to the dynamic range of the sensor",
+     NDAttrFloat64, offsetof(TLBC1_Calculations, saturation), AttrSensor},
+    {"PeakPositionX", "Peak x pixel position",
+     NDAttrUInt16, offsetof(TLBC1_Calculations, peakPositionX), AttrPosition},
+    {"PeakPositionY", "Peak y pixel position",
+     NDAttrUInt16, offsetof(TLBC1_Calculations, peakPositionY), AttrPosition},
+    {"CentroidPositionX", "Centroid x pixel position",
+     NDAttrFloat32, offsetof(TLBC1_Calculations, centroidPositionX), AttrPosition},
+    {"CentroidPositionY", "Centroid y pixel position",
+     NDAttrFloat32, offsetof(TLBC1_Calculations, centroidPositionY), AttrPosition},
+    {"BeamWidthIsoX", "Beam width in X axis (ISO 11146-2)",
+     NDAttrFloat64, offsetof(TLBC1_Calculations, beamWidthIsoX), AttrIsoWidths},
+    {"BeamWidthIsoY", "Beam width in Y axis (ISO 11146-2)",
+     NDAttrFloat64, offsetof(TLBC1_Calculations, beamWidthIsoY), AttrIsoWidths},
+    {"BeamWidthIsoXSimple", "Beam width in X axis for round profiles with ellipticity > 87% (ISO 11146-2)",
+     NDAttrFloat64, offsetof(TLBC1_Calculations, beamWidthIsoXSimple), AttrIsoWidths},
+    {"BeamWidthIsoYSimple", "Beam width in Y axis for round profiles with ellipticity > 87% (ISO 11146-2)",
+     NDAttrFloat64, offsetof(TLBC1_Calculations, beamWidthIsoYSimple), AttrIsoWidths},
+    {"BeamWidthClipX", "Horizontal beam width at clip level in pixel",
+     NDAttrFloat32, offsetof(TLBC1_Calculations, beamWidthClipX), AttrClipWidths},
+    {"BeamWidthClipY", "Vertical beam width at clip level in pixel",
+     NDAttrFloat32, offsetof(TLBC1_Calculations, beamWidthClipY), AttrClipWidths},
+    {"EllipticityIso", "Ellipticity of the beam width (ISO 11146-2)",
+     NDAttrFloat64, offsetof(TLBC1_Calculations, ellipticityIso), AttrIsoWidths},
+    {"AzimuthAngle", "Azimuth angle measured clockwise (ISO 11146-2)",
+     NDAttrFloat64, offsetof(TLBC1_Calculations, azimuthAngle), AttrIsoWidths},
+    {"EllipseDiameterMin", "Ellipse minor axis diameter in [pixel]",
+     NDAttrFloat32, offsetof(TLBC1_Calculations, ellipseDiaMin), AttrEllipse},
+    {"EllipseDiameterMax", "Ellipse major axis diameter in [pixel]",
+     NDAttrFloat32, offsetof(TLBC1_Calculations, ellipseDiaMax), AttrEllipse},
+    {"EllipseDiameterMean", "Ellipse diameter arithmetic mean value in [pixel]",
+     NDAttrFloat32, offsetof(TLBC1_Calculations, ellipseDiaMean), AttrEllipse},
+    {"EllipseOrientation", "Ellipse orientation angle in degree.",
+     NDAttrFloat32, offsetof(TLBC1_Calculations, ellipseOrientation), AttrEllipse},
+    {"EllipseEllipticity", "Ellipse's ratio of minor to major axis diameter",
+     NDAttrFloat32, offsetof(TLBC1_Calculations, ellipseEllipticity), AttrEllipse},
+    {"EllipseEccentricity", "Ellipse's eccentricity",
+     NDAttrFloat32, offsetof(TLBC1_Calculations, ellipseEccentricity), AttrEllipse},
+    {"EllipseCenterX", "Ellipse center x pixel position",
+     NDAttrFloat32, offsetof(TLBC1_Calculations, ellipseCenterX), AttrEllipse},
+    {"EllipseCenterY", "Ellipse center y pixel position",
+     NDAttrFloat32, offsetof(TLBC1_Calculations, ellipseCenterY), AttrEllipse},
+    {"EllipseFitAmplitude", "Ellipse amplitude in Fourier fit (in pixel)",
+     NDAttrFloat32, offsetof(TLBC1_Calculations, ellipseFitAmplitude), AttrEllipse},
+    {"EllipseRotAngleX", "Ellipse rotation angle in x",
+     NDAttrFloat32, offsetof(TLBC1_Calculations, rotAngleEllipseX), AttrEllipse},
+    {"EllipseRotAngleY", "Ellipse rotation angle in y",
+     NDAttrFloat32, offsetof(TLBC1_Calculations, rotAngleEllipseY), AttrEllipse},
+    {"EllipseWidthIsoX", "Ellipse width in x",
+     NDAttrFloat32, offsetof(TLBC1_Calculations, ellipseWidthIsoX), AttrEllipse},
+    {"EllipseWidthIsoY", "Ellipse width in y",
+     NDAttrFloat32, offsetof(TLBC1_Calculations, ellipseWidthIsoY), AttrEllipse},
+    {"TotalPower", "Total power in dBm",
+     NDAttrFloat32, offsetof(TLBC1_Calculations, totalPower), AttrPower},
+    {"PeakPowerDensity", "Peak power density in mW/um^2",
+     NDAttrFloat32, offsetof(TLBC1_Calculations, peakPowerDensity), AttrPower},
+    {"GaussianFitCentroidPositionX", "Centroid x pixel position for the gaussian profile",
+     NDAttrFloat32, offsetof(TLBC1_Calculations, gaussianFitCentroidPositionX), AttrFits},
+    {"GaussianFitCentroidPositionY", "Centroid y pixel position for the gaussian profile",
+     NDAttrFloat32, offsetof(TLBC1_Calculations, gaussianFitCentroidPositionY), AttrFits},
+    {"GaussianFitRatingX", "Ratio of actual data to the gaussian fit of the x profile",
+     NDAttrFloat32, offsetof(TLBC1_Calculations, gaussianFitRatingX), AttrFits},
+    {"GaussianFitRatingY", "Ratio of actual data to the gaussian fit of the y profile",
+     NDAttrFloat32, offsetof(TLBC1_Calculations, gaussianFitRatingY), AttrFits},
+    {"GaussianFitDiameterX", "Diameter for the profile X centroid",
+     NDAttrFloat32, offsetof(TLBC1_Calculations, gaussianFitDiameterX), AttrFits},
+    {"GaussianFitDiameterY", "Diameter for the profile Y centroid",
+     NDAttrFloat32, offsetof(TLBC1_Calculations, gaussianFitDiameterY), AttrFits},
+    {"CalcAreaCenterX", "Calculation area left border",
+     NDAttrFloat32, offsetof(TLBC1_Calculations, calcAreaCenterX), AttrCalcArea},
+    {"CalcAreaCenterY", "Calculation area right border",
+     NDAttrFloat32, offsetof(TLBC1_Calculations, calcAreaCenterY), AttrCalcArea},
+    {"CalcAreaWidth", "Calculation area width",
+     NDAttrFloat32, offsetof(TLBC1_Calculations, calcAreaWidth), AttrCalcArea},
+    {"CalcAreaHeight", "Calculation area height",
+     NDAttrFloat32, offsetof(TLBC1_Calculations, calcAreaHeight), AttrCalcArea},
+    {"CalcAreaAngle", "Calculation area angle in degree (counterclock)",
+     NDAttrFloat64, offsetof(TLBC1_Calculations, calcAreaAngle), AttrCalcArea},
+    {"CalcAreaLineOffset", "Pixel inside the calculation area per line",
+     NDAttrFloat64, offsetof(TLBC1_Calculations, calcAreaLineOffset), AttrCalcArea},
+    {"ProfilePeakValueX", "Peak intensity value in the x profile (in calc area)",
+     NDAttrFloat32, offsetof(TLBC1_Calculations, profilePeakValueX), AttrProfile},
+    {"ProfilePeakValueY", "Peak intensity value in the y profile (in calc area)",
+     NDAttrFloat32, offsetof(TLBC1_Calculations, profilePeakValueY), AttrProfile},
+    {"ProfilePeakPosX", "Intensity profile peak intensity x pixel position (in calc area)",
+     NDAttrUInt16, offsetof(TLBC1_Calculations, profilePeakPosX), AttrProfile},
+    {"ProfilePeakPosY", "Intensity profile peak intensity y pixel position (in calc area)",
+     NDAttrUInt16, offsetof(TLBC1_Calculations, profilePeakPosY), AttrProfile},
+    {"EffectiveArea", "Area of an ideal flat top beam with same peak intensity in um^2",
+     NDAttrFloat64, offsetof(TLBC1_Calculations, effectiveArea), AttrPower},
+    {"EffectiveBeamDiameter", "Effective beam diameter",
+     NDAttrFloat64, offsetof(TLBC1_Calculations, effectiveBeamDiameter), AttrPower},
+    {"Temperature", "Temperature",
+     NDAttrFloat64, offsetof(TLBC1_Calculations, temperature), AttrSensor},
+    {"BesselFitRatingX", "Bessel fit rating in x profile",
+     NDAttrFloat32, offsetof(TLBC1_Calculations, besselFitRatingX), AttrFits},
+    {"BesselFitRatingY", "Bessel fit rating in y profile",
+     NDAttrFloat32, offsetof(TLBC1_Calculations, besselFitRatingY), AttrFits},
+};
+
+constexpr size_t num_scan_attributes =
+    sizeof scan_attributes / sizeof scan_attributes[0];
+
+/* The attributes attached instead when the driver computes the beam moments
+ * and the SDK calculations are skipped. They use the same names as the SDK
+ * results they replace; offsets are into BeamMoments */
+constexpr ScanAttribute moment_attributes[] = {
+    {"BaseLevel", "Background level subtracted from the frame",
+     NDAttrFloat64, offsetof(BeamMoments, background), AttrSensor},
+    {"CentroidPositionX", "Centroid x pixel position",
+     NDAttrFloat64, offsetof(BeamMoments, centroid_x), AttrPosition},
+    {"CentroidPositionY", "Centroid y pixel position",
+     NDAttrFloat64, offsetof(BeamMoments, centroid_y), AttrPosition},
+    {"BeamWidthIsoX", "Beam width in X axis (ISO 11146-2)",
+     NDAttrFloat64, offsetof(BeamMoments, width_x), AttrIsoWidths},
+    {"BeamWidthIsoY", "Beam width in Y axis (ISO 11146-2)",
+     NDAttrFloat64, offsetof(BeamMoments, width_y), AttrIsoWidths},
+    {"BeamWidthIsoXSimple", "Beam width in X axis for round profiles with ellipticity > 87% (ISO 11146-2)",
+     NDAttrFloat64, offsetof(BeamMoments, width_x_simple), AttrIsoWidths},
+    {"BeamWidthIsoYSimple", "Beam width in Y axis for round profiles with ellipticity > 87% (ISO 11146-2)",
+     NDAttrFloat64, offsetof(BeamMoments, width_y_simple), AttrIsoWidths},
+    {"EllipticityIso", "Ellipticity of the beam width (ISO 11146-2)",
+     NDAttrFloat64, offsetof(BeamMoments, ellipticity), AttrIsoWidths},
+    {"AzimuthAngle", "Azimuth angle measured clockwise (ISO 11146-2)",
+     NDAttrFloat64, offsetof(BeamMoments, azimuth), AttrIsoWidths},
+};
+
+constexpr size_t num_moment_attributes =
+    sizeof moment_attributes / sizeof moment_attributes[0];
+
+/* The attributes of a table selected by ATTRIBUTE_SET, created once when
+ * the selection changes so that a frame only sets their values.
+ *
+ * NDArrayPool keeps the attributes of reused arrays unless
+ * eraseNDAttributes is set, so copying the schema into a frame that had
+ * it before updates the values in place instead of creating attributes. */
+class AttributeSchema {
+public:
+    void build(const ScanAttribute *table, size_t size, unsigned groups)
+    {
+        char zero[8] = {};
+
+        list.clear();
+        entries.clear();
+        for (size_t i = 0; i < size; i++) {
+            if (table[i].group & groups)
+                entries.push_back({list.add(table[i].name, table[i].description,
+                                            table[i].type, zero),
+                                   table[i].offset});
+        }
+    }
+
+    /* Copies the attributes into out, with the values of the fields of
+     * source */
+    void attach(NDAttributeList *out, void *source)
+    {
+        if (entries.empty())
+            return;
+
+        for (const Entry &entry : entries)
+            entry.attribute->setValue((char *)source + entry.offset);
+        list.copy(out);
+    }
+
+private:
+    struct Entry {
+        NDAttribute *attribute;
+        size_t offset;
+    };
+
+    NDAttributeList list;
+    std::vector<Entry> entries;
+};
+
+/* The scan and moment attributes selected by ATTRIBUTE_SET, and which of
+ * them, if any, each frame array carries.
+ *
+ * A reused array keeps the attributes of its previous frame, so one that
+ * last had an older selection or the other table first loses every scan
+ * and moment attribute, and only the selected ones are attached again.
+ * This happens once per array after a change. */
+class FrameAttributes {
+public:
+    void select(unsigned groups)
+    {
+        scan.build(scan_attributes, num_scan_attributes, groups);
+        moments.build(moment_attributes, num_moment_attributes, groups);
+        generation++;
+    }
+
+    void attachScan(NDArray *image, TLBC1_Calculations &data)
+    {
+        prepare(image, &scan);
+        scan.attach(image->pAttributeList, &data);
+    }
+
+    void attachMoments(NDArray *image, BeamMoments &data)
+    {
+        prepare(image, &moments);
+        moments.attach(image->pAttributeList, &data);
+    }
+
+    /* Removes the attributes from a frame without beam results */
+    void detach(NDArray *image)
+    {
+        prepare(image, nullptr);
+    }
+
+private:
+    struct State {
+        unsigned generation;
+        const AttributeSchema *schema;
+    };
+
+    /* Arrays freed when a pool is refilled leave entries behind, so the
+     * map starts over at this size, which costs one removal per array */
+    static constexpr size_t max_arrays = 256;
+
+    AttributeSchema scan, moments;
+    unsigned generation = 0;
+    std::map<NDArray *, State> arrays;
+
+    void prepare(NDArray *image, const AttributeSchema *schema)
+    {
+        auto found = arrays.find(image);
+        if (found != arrays.end() && found->second.generation == generation &&
+            found->second.schema == schema)
+            return;
+
+        for (const ScanAttribute &attr : scan_attributes)
+            image->pAttributeList->remove(attr.name);
+        for (const ScanAttribute &attr : moment_attributes)
+            image->pAttributeList->remove(attr.name);
+
+        if (arrays.size() >= max_arrays)
+            arrays.clear();
+        arrays[image] = {generation, schema};
+    }
+};
+
+#endif /* TLBC2ATTRIBUTES_H */
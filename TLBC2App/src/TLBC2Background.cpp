@@ -0,0 +1,190 @@
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#include "TLBC2Background.h"
+#include "TLBC2Workers.h"
+
+namespace {
+
+/* Pixels per chunk, so that waking up a worker is worth it */
+constexpr size_t min_pixels_per_chunk = 64 * 1024;
+
+/* Exposure times and gains closer than this, relative, are the same */
+constexpr double setting_tolerance = 1e-3;
+
+constexpr char file_magic[8] = {'T', 'L', 'B', 'C', '2', 'D', 'R', 'K'};
+constexpr epicsUInt32 file_version = 1;
+
+bool same_setting(double a, double b)
+{
+    return std::fabs(a - b) <= setting_tolerance * std::max(std::fabs(a), std::fabs(b));
+}
+
+/* A plain element-wise loop without branches so the compiler vectorizes
+ * it; the conditional subtraction becomes a saturating subtraction */
+template<typename T>
+void subtract_row(T *row, const epicsUInt16 *dark, size_t width)
+{
+    for (size_t x = 0; x < width; x++)
+        row[x] = (T)(row[x] > dark[x] ? row[x] - dark[x] : 0);
+}
+
+template<typename T>
+void subtract(WorkerPool &pool, T *frame, int left, int top, int width, int height,
+              const DarkFrame &dark)
+{
+    const size_t min_rows = std::max<size_t>(min_pixels_per_chunk / std::max(width, 1), 1);
+
+    pool.parallel_for(height, min_rows, [&](size_t, size_t begin, size_t end) {
+        for (size_t y = begin; y < end; y++) {
+            const epicsUInt16 *dark_row = dark.data.data() +
+                (size_t)(top - dark.top + y) * dark.width + (left - dark.left);
+
+            subtract_row(frame + y * width, dark_row, width);
+        }
+    });
+}
+
+struct FileHeader {
+    epicsInt32 left, top, width, height, bpp, frames;
+    double exposure, gain;
+};
+
+} // namespace
+
+bool DarkFrame::applies(int roi_left, int roi_top, int roi_width, int roi_height,
+                        int roi_bpp, double roi_exposure, double roi_gain) const
+{
+    return bpp == roi_bpp && same_setting(exposure, roi_exposure) &&
+        same_setting(gain, roi_gain) &&
+        roi_left >= left && roi_left + roi_width <= left + width &&
+        roi_top >= top && roi_top + roi_height <= top + height;
+}
+
+const DarkFrame *DarkFrames::find(int left, int top, int width, int height, int bpp,
+                                  double exposure, double gain) const
+{
+    const DarkFrame *best = nullptr;
+
+    for (const auto &frame : frames) {
+        if (frame->applies(left, top, width, height, bpp, exposure, gain) &&
+            (!best || frame->data.size() < best->data.size()))
+            best = frame.get();
+    }
+
+    return best;
+}
+
+void DarkFrames::store(std::shared_ptr<const DarkFrame> frame)
+{
+    auto same = [&](const std::shared_ptr<const DarkFrame> &other) {
+        return other->left == frame->left && other->top == frame->top &&
+            other->width == frame->width && other->height == frame->height &&
+            other->bpp == frame->bpp && same_setting(other->exposure, frame->exposure) &&
+            same_setting(other->gain, frame->gain);
+    };
+
+    frames.erase(std::remove_if(frames.begin(), frames.end(), same), frames.end());
+    frames.push_back(std::move(frame));
+
+    if (frames.size() > max_frames)
+        frames.erase(frames.begin());
+}
+
+void DarkFrames::save(const char *path) const
+{
+    FILE *file = fopen(path, "wb");
+    if (!file)
+        throw std::runtime_error(std::string("cannot create ") + path + ": " + strerror(errno));
+
+    const epicsUInt32 count = frames.size();
+    bool ok = fwrite(file_magic, sizeof file_magic, 1, file) == 1 &&
+        fwrite(&file_version, sizeof file_version, 1, file) == 1 &&
+        fwrite(&count, sizeof count, 1, file) == 1;
+
+    for (const auto &frame : frames) {
+        const FileHeader header = {frame->left, frame->top, frame->width, frame->height,
+                                   frame->bpp, frame->frames, frame->exposure, frame->gain};
+
+        ok = ok && fwrite(&header, sizeof header, 1, file) == 1 &&
+            fwrite(frame->data.data(), sizeof frame->data[0], frame->data.size(), file) ==
+                frame->data.size();
+    }
+
+    if (fclose(file) != 0 || !ok)
+        throw std::runtime_error(std::string("cannot write ") + path);
+}
+
+void DarkFrames::load(const char *path)
+{
+    FILE *file = fopen(path, "rb");
+    if (!file)
+        throw std::runtime_error(std::string("cannot open ") + path + ": " + strerror(errno));
+
+    std::vector<std::shared_ptr<const DarkFrame>> loaded;
+    std::string error;
+    char magic[sizeof file_magic];
+    epicsUInt32 version, count;
+
+    if (fread(magic, sizeof magic, 1, file) != 1 || memcmp(magic, file_magic, sizeof magic) ||
+        fread(&version, sizeof version, 1, file) != 1 || version != file_version ||
+        fread(&count, sizeof count, 1, file) != 1 || count > max_frames)
+        error = "not a dark frame file";
+
+    for (epicsUInt32 i = 0; error.empty() && i < count; i++) {
+        FileHeader header;
+        if (fread(&header, sizeof header, 1, file) != 1 ||
+            header.width < 1 || header.width > 65535 ||
+            header.height < 1 || header.height > 65535 ||
+            (header.bpp != 1 && header.bpp != 2) || header.frames < 1) {
+            error = "bad dark frame header";
+            break;
+        }
+
+        auto frame = std::make_shared<DarkFrame>();
+        *frame = {header.left, header.top, header.width, header.height, header.bpp,
+                  header.exposure, header.gain, header.frames, {}};
+        frame->data.resize((size_t)header.width * header.height);
+
+        if (fread(frame->data.data(), sizeof frame->data[0], frame->data.size(), file) !=
+                frame->data.size()) {
+            error = "truncated";
+            break;
+        }
+        loaded.push_back(frame);
+    }
+
+    fclose(file);
+    if (!error.empty())
+        throw std::runtime_error(std::string(path) + ": " + error);
+
+    frames.swap(loaded);
+}
+
+void average_dark(const epicsUInt32 *sum, size_t pixels, unsigned frames,
+                  DarkFrame &dark)
+{
+    frames = std::max(frames, 1u);
+    dark.frames = frames;
+    dark.data.resize(pixels);
+
+    for (size_t i = 0; i < pixels; i++)
+        dark.data[i] = (epicsUInt16)((sum[i] + frames / 2) / frames);
+}
+
+void subtract_dark(WorkerPool &pool, epicsUInt8 *frame, int left, int top,
+                   int width, int height, const DarkFrame &dark)
+{
+    subtract(pool, frame, left, top, width, height, dark);
+}
+
+void subtract_dark(WorkerPool &pool, epicsUInt16 *frame, int left, int top,
+                   int width, int height, const DarkFrame &dark)
+{
+    subtract(pool, frame, left, top, width, height, dark);
+}
@@ -0,0 +1,66 @@
+#ifndef TLBC2BACKGROUND_H
+#define TLBC2BACKGROUND_H
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+#include <epicsTypes.h>
+
+class WorkerPool;
+
+/* The average of frames taken with the beam blocked, subtracted from later
+ * frames taken with the same settings */
+struct DarkFrame {
+    int left, top, width, height;   /* sensor pixels */
+    int bpp;                        /* bytes per pixel of the frames */
+    double exposure;                /* seconds */
+    double gain;
+    int frames;                     /* number of frames averaged */
+    std::vector<epicsUInt16> data;  /* width x height, rounded averages */
+
+    /* Whether it was taken with this pixel format, exposure time and gain,
+     * and covers the ROI */
+    bool applies(int roi_left, int roi_top, int roi_width, int roi_height,
+                 int roi_bpp, double roi_exposure, double roi_gain) const;
+};
+
+/* The dark frames for different settings. Frames are shared and never
+ * modified, so a copy of the set is cheap and can be used without a lock
+ * while the original changes */
+class DarkFrames {
+public:
+    static constexpr size_t max_frames = 8;
+
+    /* The smallest dark frame that applies, or NULL */
+    const DarkFrame *find(int left, int top, int width, int height, int bpp,
+                          double exposure, double gain) const;
+
+    /* Replaces a dark frame with the same ROI and settings, and drops the
+     * oldest if there are more than max_frames */
+    void store(std::shared_ptr<const DarkFrame> frame);
+
+    size_t size() const { return frames.size(); }
+
+    /* Both throw std::runtime_error. load() leaves the set unchanged on
+     * errors. The format is the native byte order */
+    void save(const char *path) const;
+    void load(const char *path);
+
+private:
+    std::vector<std::shared_ptr<const DarkFrame>> frames;
+};
+
+/* Divides the sums of frames frames, added up with accumulate_frame(), into
+ * dark.data */
+void average_dark(const epicsUInt32 *sum, size_t pixels, unsigned frames,
+                  DarkFrame &dark);
+
+/* Subtracts dark from a width x height frame at left, top of the sensor in
+ * place, clamping at 0. The dark frame must apply to the frame */
+void subtract_dark(WorkerPool &pool, epicsUInt8 *frame, int left, int top,
+                   int width, int height, const DarkFrame &dark);
+void subtract_dark(WorkerPool &pool, epicsUInt16 *frame, int left, int top,
+                   int width, int height, const DarkFrame &dark);
+
+#endif /* TLBC2BACKGROUND_H */
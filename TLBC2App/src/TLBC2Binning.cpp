@@ -0,0 +1,101 @@
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "TLBC2Binning.h"
+
+namespace {
+
+/* Adds up the F x F blocks of one output row. The frame is read one input
+ * row at a time into a row of accumulators, so memory is streamed in order
+ * and the constant block width lets the compiler vectorize the inner loop */
+template<unsigned F, typename T>
+void bin_row(const T *src, size_t width, size_t out_width, epicsUInt32 *acc)
+{
+    for (size_t x = 0; x < out_width; x++)
+        acc[x] = 0;
+
+    for (unsigned r = 0; r < F; r++) {
+        const T *row = src + r * width;
+
+        for (size_t x = 0; x < out_width; x++) {
+            epicsUInt32 sum = 0;
+
+            for (unsigned k = 0; k < F; k++)
+                sum += row[x * F + k];
+
+            acc[x] += sum;
+        }
+    }
+}
+
+template<unsigned F, typename T, typename D>
+void bin(const T *src, size_t width, size_t height, bool mean, D *dst)
+{
+    const size_t out_width = width / F, out_height = height / F;
+    constexpr epicsUInt32 n = F * F;
+    std::vector<epicsUInt32> acc(out_width);
+
+    for (size_t y = 0; y < out_height; y++) {
+        D *out = dst + y * out_width;
+
+        bin_row<F>(src + y * F * width, width, out_width, acc.data());
+
+        if (mean) {
+            for (size_t x = 0; x < out_width; x++)
+                out[x] = (D)((acc[x] + n / 2) / n);
+        } else {
+            for (size_t x = 0; x < out_width; x++)
+                out[x] = (D)acc[x];
+        }
+    }
+}
+
+template<typename T, typename D>
+void bin(const T *src, size_t width, size_t height, unsigned factor, bool mean,
+         D *dst)
+{
+    switch (factor) {
+    case 1:
+        bin<1>(src, width, height, mean, dst);
+        break;
+    case 2:
+        bin<2>(src, width, height, mean, dst);
+        break;
+    case 4:
+        bin<4>(src, width, height, mean, dst);
+        break;
+    case 8:
+        bin<8>(src, width, height, mean, dst);
+        break;
+    default:
+        throw std::invalid_argument("unsupported binning factor " +
+                                    std::to_string(factor));
+    }
+}
+
+}
+
+void bin_frame_mean(const epicsUInt8 *src, size_t width, size_t height,
+                    unsigned factor, epicsUInt8 *dst)
+{
+    bin(src, width, height, factor, true, dst);
+}
+
+void bin_frame_mean(const epicsUInt16 *src, size_t width, size_t height,
+                    unsigned factor, epicsUInt16 *dst)
+{
+    bin(src, width, height, factor, true, dst);
+}
+
+void bin_frame_sum(const epicsUInt8 *src, size_t width, size_t height,
+                   unsigned factor, epicsUInt16 *dst)
+{
+    bin(src, width, height, factor, false, dst);
+}
+
+void bin_frame_sum(const epicsUInt16 *src, size_t width, size_t height,
+                   unsigned factor, epicsUInt32 *dst)
+{
+    bin(src, width, height, factor, false, dst);
+}
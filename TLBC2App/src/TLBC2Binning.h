@@ -0,0 +1,23 @@
+#ifndef TLBC2BINNING_H
+#define TLBC2BINNING_H
+
+#include <cstddef>
+
+#include <epicsTypes.h>
+
+/* Bins a width x height frame into factor x factor blocks, for factors of
+ * 1, 2, 4 and 8. The output is width / factor x height / factor; rows and
+ * columns that do not fill a block are dropped.
+ *
+ * The mean keeps the pixel type. The sum needs the wider output types, which
+ * hold an 8x8 block of the widest pixels */
+void bin_frame_mean(const epicsUInt8 *src, size_t width, size_t height,
+                    unsigned factor, epicsUInt8 *dst);
+void bin_frame_mean(const epicsUInt16 *src, size_t width, size_t height,
+                    unsigned factor, epicsUInt16 *dst);
+void bin_frame_sum(const epicsUInt8 *src, size_t width, size_t height,
+                   unsigned factor, epicsUInt16 *dst);
+void bin_frame_sum(const epicsUInt16 *src, size_t width, size_t height,
+                   unsigned factor, epicsUInt32 *dst);
+
+#endif /* TLBC2BINNING_H */
@@ -0,0 +1,100 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include <epicsTypes.h>
+
+#include "TLBC2Codec.h"
+#include "TLBC2Workers.h"
+
+#ifdef HAVE_BITSHUFFLE
+
+#include <bitshuffle.h>
+
+const bool bslz4_available = true;
+
+namespace {
+
+constexpr size_t header_size = 12;
+
+/* Blocks per range, so that waking up a worker is worth it */
+constexpr size_t min_blocks = 16;
+
+void write_be(unsigned char *out, epicsUInt64 value, size_t bytes)
+{
+    for (size_t i = bytes; i-- > 0; value >>= 8)
+        out[i] = (unsigned char)value;
+}
+
+} // namespace
+
+size_t bslz4_bound(size_t elements, size_t elem_size)
+{
+    const size_t block = bshuf_default_block_size(elem_size);
+
+    return header_size + bshuf_compress_lz4_bound(elements, elem_size, block);
+}
+
+size_t compress_bslz4(WorkerPool &pool, const void *in, size_t elements,
+                      size_t elem_size, void *out)
+{
+    const size_t block = bshuf_default_block_size(elem_size);
+    const size_t blocks = std::max<size_t>(elements / block, 1);
+
+    /* The bound is the same for every whole block, so each range can be
+     * compressed at the offset of its first block's bound and the results
+     * moved together afterwards */
+    const size_t block_bound = bshuf_compress_lz4_bound(block, elem_size, block);
+    unsigned char *const data = (unsigned char *)out + header_size;
+
+    struct Range {
+        bool done;
+        size_t offset;
+        int64_t size;   /* negative on errors */
+    };
+    std::vector<Range> ranges(pool.size(), Range{false, 0, 0});
+
+    pool.parallel_for(blocks, min_blocks, [&](size_t chunk, size_t begin, size_t end) {
+        /* the last range also takes the elements after the last whole block */
+        const size_t first = begin * block;
+        const size_t count = end == blocks ? elements - first : (end - begin) * block;
+        Range &range = ranges[chunk];
+
+        range.offset = begin * block_bound;
+        range.size = bshuf_compress_lz4((const char *)in + first * elem_size,
+                                        data + range.offset, count, elem_size, block);
+        range.done = true;
+    });
+
+    size_t size = 0;
+    for (const Range &range : ranges) {
+        if (!range.done)
+            break;
+        if (range.size < 0)
+            return 0;
+
+        memmove(data + size, data + range.offset, range.size);
+        size += range.size;
+    }
+
+    write_be((unsigned char *)out, (epicsUInt64)elements * elem_size, 8);
+    write_be((unsigned char *)out + 8, block * elem_size, 4);
+    return header_size + size;
+}
+
+#else
+
+const bool bslz4_available = false;
+
+size_t bslz4_bound(size_t, size_t)
+{
+    return 0;
+}
+
+size_t compress_bslz4(WorkerPool &, const void *, size_t, size_t, void *)
+{
+    return 0;
+}
+
+#endif /* HAVE_BITSHUFFLE */
@@ -0,0 +1,29 @@
+#ifndef TLBC2CODEC_H
+#define TLBC2CODEC_H
+
+#include <cstddef>
+
+class WorkerPool;
+
+/* Compression of frames into ADCore's "bslz4" NDArray codec: a 12 byte
+ * header (the uncompressed size and the block size in bytes, big endian)
+ * followed by bitshuffled, LZ4-compressed blocks. This is what NDPluginCodec
+ * produces and the HDF5 bitshuffle filter stores, so NDFileHDF5 can write
+ * the frames as chunks without recompressing them.
+ *
+ * Only available when built with HAVE_BITSHUFFLE, otherwise bslz4_available
+ * is false and nothing is compressed */
+extern const bool bslz4_available;
+
+/* Largest compressed size of elements values of elem_size bytes */
+size_t bslz4_bound(size_t elements, size_t elem_size);
+
+/* Compresses elements values of elem_size bytes into out, which must hold
+ * bslz4_bound() bytes. The frame is split into ranges of whole blocks that
+ * are compressed on the pool's threads; since blocks are independent, the
+ * result is the same as compressing it in one go. Returns the compressed
+ * size, or 0 on errors */
+size_t compress_bslz4(WorkerPool &pool, const void *in, size_t elements,
+                      size_t elem_size, void *out);
+
+#endif /* TLBC2CODEC_H */
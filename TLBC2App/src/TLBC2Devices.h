@@ -0,0 +1,133 @@
+#ifndef TLBC2DEVICES_H
+#define TLBC2DEVICES_H
+
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <epicsGuard.h>
+#include <epicsMutex.h>
+
+#include <visa.h>
+#include <TLBC2.h>
+
+/* The profilers found by the SDK, shared by every port of the IOC.
+ *
+ * Enumerating is slow (the SDK queries each USB device), so it is done once
+ * and only repeated when a port asks for a device that is not in the list,
+ * e.g. one plugged in after IOC start. The directory also records which
+ * port claimed each device, so two ports cannot open the same one and ports
+ * without a selection get the next unclaimed device. */
+class DeviceDirectory {
+public:
+    struct Device {
+        std::string resource_name;
+        std::string manufacturer;
+        std::string model_name;
+        std::string serial_number;
+        std::string port;           /* empty if not claimed */
+    };
+
+    /* Claims the device whose serial number or resource name is selector,
+     * or the first unclaimed device if selector is empty or NULL. check is
+     * called with the status and name of every SDK call and must throw on
+     * errors. Throws std::runtime_error if there is no such device or it is
+     * claimed already */
+    template<typename Check>
+    Device claim(const char *selector, const char *port, Check &&check)
+    {
+        epicsGuard<epicsMutex> guard(lock);
+        const std::string wanted = selector ? selector : "";
+
+        if (!enumerated)
+            enumerate(check);
+
+        Device *device = find(wanted);
+        if (!device) {
+            enumerate(check);
+            device = find(wanted);
+        }
+
+        if (!device) {
+            std::string message = wanted.empty() ?
+                "no unclaimed devices" : "no device " + wanted;
+            if (!devices.empty()) {
+                message += " (found";
+                for (const Device &found : devices)
+                    message += " " + found.serial_number + (found.port.empty() ? "" : "@" + found.port);
+                message += ")";
+            }
+            throw std::runtime_error(message);
+        }
+
+        if (!device->port.empty())
+            throw std::runtime_error("device " + device->serial_number +
+                                     " already used by port " + device->port);
+
+        device->port = port;
+        return *device;
+    }
+
+    /* Ports that claimed a device, in device order */
+    std::vector<std::string> ports()
+    {
+        epicsGuard<epicsMutex> guard(lock);
+        std::vector<std::string> claimed;
+
+        for (const Device &device : devices) {
+            if (!device.port.empty())
+                claimed.push_back(device.port);
+        }
+
+        return claimed;
+    }
+
+private:
+    epicsMutex lock;
+    std::vector<Device> devices;
+    bool enumerated = false;
+
+    Device *find(const std::string &wanted)
+    {
+        for (Device &device : devices) {
+            if (wanted.empty() ? device.port.empty() :
+                    wanted == device.serial_number || wanted == device.resource_name)
+                return &device;
+        }
+
+        return nullptr;
+    }
+
+    /* Refreshes the list, keeping the claims of devices still present */
+    template<typename Check>
+    void enumerate(Check &check)
+    {
+        ViUInt32 count = 0;
+        check(TLBC2_get_device_count(VI_NULL, &count), "get_device_count");
+
+        std::vector<Device> found;
+        for (ViUInt32 i = 0; i < count; i++) {
+            ViBoolean available;
+            ViChar resource_name[256];
+            ViChar manufacturer[64];
+            ViChar model_name[64];
+            ViChar serial_number[64];
+
+            check(TLBC2_get_device_information(VI_NULL, i, manufacturer, model_name,
+                                               serial_number, &available, resource_name),
+                  "get_device_information");
+
+            Device device = {resource_name, manufacturer, model_name, serial_number, ""};
+            for (const Device &known : devices) {
+                if (known.resource_name == device.resource_name)
+                    device.port = known.port;
+            }
+            found.push_back(device);
+        }
+
+        devices.swap(found);
+        enumerated = true;
+    }
+};
+
+#endif /* TLBC2DEVICES_H */
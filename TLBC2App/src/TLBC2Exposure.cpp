@@ -0,0 +1,104 @@
+#include <algorithm>
+#include <cmath>
+
+#include "TLBC2Exposure.h"
+
+namespace {
+
+constexpr unsigned max_full_scale = 4095;
+
+/* Largest changes of the exposure, as very dark frames give a coarse level
+ * and the extrapolation from saturated frames is rough */
+constexpr double max_increase = 64.;
+constexpr double max_decrease = 1024.;
+
+template<typename T>
+FrameLevels measure(const T *data, size_t width, size_t height, unsigned full_scale,
+                    double percentile)
+{
+    full_scale = std::clamp(full_scale, 1u, max_full_scale);
+
+    epicsUInt32 histogram[max_full_scale + 1] = {};
+    size_t samples = 0;
+
+    for (size_t y = 0; y < height; y += 2) {
+        const T *row = data + y * width;
+
+        for (size_t x = 0; x < width; x += 2)
+            histogram[std::min<unsigned>(row[x], full_scale)]++;
+        samples += (width + 1) / 2;
+    }
+
+    FrameLevels levels = {0, 0};
+    if (!samples)
+        return levels;
+
+    /* the smallest value with at least fraction of the samples at or below
+     * it */
+    auto quantile = [&](double fraction) {
+        const double rank = fraction * samples;
+        size_t seen = 0;
+        unsigned value = 0;
+
+        while (value < full_scale && seen + histogram[value] < rank)
+            seen += histogram[value++];
+        return value;
+    };
+
+    levels.background = (double)quantile(0.5) / full_scale;
+    levels.level = (double)quantile(std::clamp(percentile, 0., 100.) / 100.) / full_scale;
+
+    if (levels.level >= 1.) {
+        /* The area above level L of a Gaussian peak P is proportional to
+         * ln(P / L), so the areas above full scale F and F / 2 differ by
+         * ln(2) units and P / F = 2^(saturated area / difference) */
+        size_t saturated = histogram[full_scale], above_half = 0;
+        for (unsigned value = (full_scale + 1) / 2; value <= full_scale; value++)
+            above_half += histogram[value];
+
+        levels.level = above_half > saturated ?
+            std::pow(2., std::min((double)saturated / (above_half - saturated), 10.)) :
+            max_decrease;
+    }
+
+    return levels;
+}
+
+} // namespace
+
+FrameLevels measure_levels(const epicsUInt8 *data, size_t width, size_t height,
+                           unsigned full_scale, double percentile)
+{
+    return measure(data, width, height, full_scale, percentile);
+}
+
+FrameLevels measure_levels(const epicsUInt16 *data, size_t width, size_t height,
+                           unsigned full_scale, double percentile)
+{
+    return measure(data, width, height, full_scale, percentile);
+}
+
+ExposureSetting next_exposure(const FrameLevels &levels, double target,
+                              ExposureSetting current, const ExposureLimits &limits)
+{
+    const double signal = std::max(levels.level - levels.background, 1e-6);
+    const double factor = std::clamp(std::max(target - levels.background, 1e-6) / signal,
+                                     1. / max_decrease, max_increase);
+
+    /* the exposure time that would give the target at the current
+     * attenuation */
+    double exposure = current.exposure * factor;
+    double attenuation = current.attenuation;
+
+    if (limits.use_attenuation) {
+        if (exposure > limits.max_exposure)
+            attenuation -= 10. * std::log10(exposure / limits.max_exposure);
+        else if (exposure < limits.min_exposure)
+            attenuation += 10. * std::log10(limits.min_exposure / exposure);
+
+        attenuation = std::clamp(attenuation, limits.min_attenuation, limits.max_attenuation);
+        exposure *= std::pow(10., (attenuation - current.attenuation) / 10.);
+    }
+
+    return {std::clamp(exposure, limits.min_exposure, limits.max_exposure), attenuation};
+}
@@ -0,0 +1,47 @@
+#ifndef TLBC2EXPOSURE_H
+#define TLBC2EXPOSURE_H
+
+#include <cstddef>
+
+#include <epicsTypes.h>
+
+/* Brightness of a frame for exposure control, from a histogram of every
+ * other pixel of every other row. Levels are fractions of full scale */
+struct FrameLevels {
+    double level;       /* that percentile % of the sampled pixels do not
+                         * exceed. When they are saturated, the peak level
+                         * is extrapolated from the areas at and above half
+                         * full scale, assuming a Gaussian-like profile, and
+                         * is above 1 */
+    double background;  /* the median */
+};
+
+/* full_scale is the largest pixel value, at most 4095. Larger values count
+ * as full scale */
+FrameLevels measure_levels(const epicsUInt8 *data, size_t width, size_t height,
+                           unsigned full_scale, double percentile);
+FrameLevels measure_levels(const epicsUInt16 *data, size_t width, size_t height,
+                           unsigned full_scale, double percentile);
+
+struct ExposureLimits {
+    double min_exposure;        /* seconds */
+    double max_exposure;
+    double min_attenuation;     /* dB */
+    double max_attenuation;
+    bool use_attenuation;
+};
+
+struct ExposureSetting {
+    double exposure;            /* seconds */
+    double attenuation;         /* dB */
+};
+
+/* Returns the exposure time and attenuation expected to bring a frame of
+ * the given level to target, assuming the signal is proportional to the
+ * exposure time and to 10^(-attenuation / 10). The exposure time is changed
+ * first; the attenuation only when the exposure time alone cannot reach the
+ * target. The background is assumed not to depend on the exposure */
+ExposureSetting next_exposure(const FrameLevels &levels, double target,
+                              ExposureSetting current, const ExposureLimits &limits);
+
+#endif /* TLBC2EXPOSURE_H */
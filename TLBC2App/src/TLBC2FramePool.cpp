@@ -0,0 +1,64 @@
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#include "TLBC2FramePool.h"
+
+FramePool::FramePool(asynNDArrayDriver *driver):
+    NDArrayPool(driver, 0)
+{
+}
+
+void FramePool::prewarm(int frames, size_t size)
+{
+    max_frames = std::max(frames, 1);
+
+    /* free buffers large enough are kept from the previous acquisition;
+     * they are replaced if they are too small or too many */
+    if (size > buffer_size || getNumBuffers() > max_frames) {
+        emptyFreeList();
+        buffer_size = size;
+    }
+
+    /* alloc takes the free buffers first, which were written before.
+     * Writing the new ones makes the system map their pages now rather
+     * than while the first frames are captured */
+    const int reused = getNumFree();
+    size_t dims = buffer_size;
+    std::vector<NDArray *> arrays;
+    for (int i = inUse(); i < max_frames; i++) {
+        NDArray *pArray = alloc(1, &dims, NDUInt8, buffer_size, NULL);
+        if (!pArray)
+            break;
+        if ((int)arrays.size() >= reused)
+            memset(pArray->pData, 0, buffer_size);
+        arrays.push_back(pArray);
+    }
+
+    for (NDArray *pArray : arrays)
+        pArray->release();
+}
+
+NDArray *FramePool::allocFrame(int ndims, size_t *dims, NDDataType_t dataType, size_t size)
+{
+    if (exhausted())
+        return NULL;
+
+    /* the free buffers are too small for the new ROI */
+    if (size > buffer_size) {
+        emptyFreeList();
+        buffer_size = size;
+    }
+
+    return alloc(ndims, dims, dataType, size, NULL);
+}
+
+int FramePool::inUse()
+{
+    return getNumBuffers() - getNumFree();
+}
+
+void FramePool::onReleaseArray(NDArray *)
+{
+    release_event.trigger();
+}
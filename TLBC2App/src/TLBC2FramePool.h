@@ -0,0 +1,47 @@
+#ifndef TLBC2FRAMEPOOL_H
+#define TLBC2FRAMEPOOL_H
+
+#include <cstddef>
+
+#include <epicsEvent.h>
+#include <NDArray.h>
+
+/* The NDArrays that frames are captured into, limited to a number of frames
+ * instead of ADCore's memory limit.
+ *
+ * The buffers are allocated when an acquisition starts, and kept for the
+ * next one, so capturing does not allocate, and return to the pool once the publisher and every plugin
+ * released them. Only the capture thread allocates from the pool, so a free
+ * frame it sees stays free until it allocates it. */
+class FramePool: public NDArrayPool {
+public:
+    explicit FramePool(asynNDArrayDriver *driver);
+
+    /* Sets the number of frames and allocates the missing ones with at
+     * least size bytes. Free buffers that are large enough are kept,
+     * smaller ones replaced. Frames still held by plugins count against the
+     * limit until they are released */
+    void prewarm(int frames, size_t size);
+
+    /* Returns NULL if every frame is in use or the allocation failed. A
+     * buffer larger than the prewarmed ones replaces the free buffers */
+    NDArray *allocFrame(int ndims, size_t *dims, NDDataType_t dataType, size_t size);
+
+    int frames() const { return max_frames; }
+    int inUse();
+    bool exhausted() { return inUse() >= max_frames; }
+
+    /* Waits up to timeout seconds for a frame to be released. Returns false
+     * on timeout */
+    bool waitRelease(double timeout) { return release_event.wait(timeout); }
+
+protected:
+    void onReleaseArray(NDArray *pArray) override;
+
+private:
+    int max_frames = 1;
+    size_t buffer_size = 0;
+    epicsEvent release_event;
+};
+
+#endif /* TLBC2FRAMEPOOL_H */
@@ -0,0 +1,56 @@
+#include <algorithm>
+#include <limits>
+
+#include "TLBC2Latency.h"
+
+double LatencyHistogram::bucket_start(size_t index)
+{
+    if (index < 4)
+        return (double)index;
+
+    const size_t octave = index / 4 + 1, sub = index % 4;
+    return (double)((epicsUInt64)(4 + sub) << (octave - 2));
+}
+
+LatencyHistogram::Summary LatencyHistogram::summary() const
+{
+    epicsUInt64 buckets[num_buckets];
+    Summary summary = {0, 0, 0, (double)max_us.load(std::memory_order_relaxed)};
+
+    for (size_t i = 0; i < num_buckets; i++) {
+        buckets[i] = counts[i].load(std::memory_order_relaxed);
+        summary.count += buckets[i];
+    }
+
+    if (!summary.count)
+        return summary;
+
+    auto percentile = [&](double fraction) {
+        const epicsUInt64 rank = std::max<epicsUInt64>(
+            (epicsUInt64)(fraction * summary.count + 0.5), 1);
+        epicsUInt64 seen = 0;
+
+        for (size_t i = 0; i < num_buckets; i++) {
+            seen += buckets[i];
+            if (seen >= rank) {
+                const double end = i + 1 < num_buckets ? bucket_start(i + 1) : summary.max;
+                return std::min(end, summary.max);
+            }
+        }
+
+        return summary.max;
+    };
+
+    summary.p50 = percentile(0.50);
+    summary.p99 = percentile(0.99);
+
+    return summary;
+}
+
+void LatencyHistogram::snapshot(epicsInt32 buckets[num_buckets]) const
+{
+    for (size_t i = 0; i < num_buckets; i++)
+        buckets[i] = (epicsInt32)std::min<epicsUInt32>(
+            counts[i].load(std::memory_order_relaxed),
+            std::numeric_limits<epicsInt32>::max());
+}
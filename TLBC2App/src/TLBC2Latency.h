@@ -0,0 +1,74 @@
+#ifndef TLBC2LATENCY_H
+#define TLBC2LATENCY_H
+
+#include <atomic>
+#include <cstddef>
+
+#include <epicsTypes.h>
+
+/* A histogram of durations that any thread can add to without locking.
+ *
+ * Buckets are in microseconds, four per power of two: 0, 1, 2, 3, 4, 5, 6,
+ * 7, 8, 10, 12, 14, 16, 20, ... The last bucket also takes everything
+ * longer. Percentiles are reported as the upper edge of their bucket, so
+ * they are at most 25% high */
+class LatencyHistogram {
+public:
+    static constexpr size_t num_buckets = 96;
+
+    struct Summary {
+        epicsUInt64 count;
+        double p50;     /* microseconds */
+        double p99;
+        double max;
+    };
+
+    void record(epicsUInt64 ns)
+    {
+        const epicsUInt64 us = ns / 1000;
+
+        counts[bucket(us)].fetch_add(1, std::memory_order_relaxed);
+
+        epicsUInt64 current = max_us.load(std::memory_order_relaxed);
+        while (us > current &&
+               !max_us.compare_exchange_weak(current, us, std::memory_order_relaxed))
+            ;
+    }
+
+    /* Not atomic as a whole: durations recorded while resetting may be
+     * kept or lost */
+    void reset()
+    {
+        for (auto &count : counts)
+            count.store(0, std::memory_order_relaxed);
+        max_us.store(0, std::memory_order_relaxed);
+    }
+
+    Summary summary() const;
+
+    /* Copies the bucket counts, saturated to 32 bits for waveforms */
+    void snapshot(epicsInt32 buckets[num_buckets]) const;
+
+    /* Lower edge of a bucket in microseconds */
+    static double bucket_start(size_t index);
+
+private:
+    std::atomic<epicsUInt32> counts[num_buckets] = {};
+    std::atomic<epicsUInt64> max_us{0};
+
+    static size_t bucket(epicsUInt64 us)
+    {
+        if (us < 4)
+            return us;
+
+        /* position of the highest bit, and the two bits below it */
+        int msb = 63;
+        while (!(us >> msb))
+            msb--;
+
+        const size_t index = 4 * (msb - 1) + ((us >> (msb - 2)) & 3);
+        return index < num_buckets ? index : num_buckets - 1;
+    }
+};
+
+#endif /* TLBC2LATENCY_H */
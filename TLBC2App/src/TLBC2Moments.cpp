@@ -0,0 +1,243 @@
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#include "TLBC2Moments.h"
+#include "TLBC2Workers.h"
+
+namespace {
+
+constexpr double pi = 3.14159265358979323846;
+
+/* Rows per range handed to a worker; smaller frames are not worth waking
+ * the pool for */
+constexpr size_t min_rows_per_chunk = 64;
+
+/* Maximum number of times the integration window is refined */
+constexpr int max_iterations = 8;
+
+/* Pixels need to be this many noise standard deviations above the
+ * background to contribute */
+constexpr double noise_threshold = 3;
+
+/* Raw moments of the background-subtracted intensity over a window */
+struct Sums {
+    double s0 = 0, sx = 0, sy = 0, sxx = 0, syy = 0, sxy = 0;
+
+    void add(const Sums &other)
+    {
+        s0 += other.s0;
+        sx += other.sx;
+        sy += other.sy;
+        sxx += other.sxx;
+        syy += other.syy;
+        sxy += other.sxy;
+    }
+};
+
+/* Zeroth, first and second moments of one row. The pixels are spread over
+ * independent accumulators so that the compiler can keep them in vector
+ * registers without reordering floating point additions */
+template<typename T>
+inline void row_sums(const T *row, size_t x0, size_t x1, double background,
+                     double threshold, double &r0, double &r1, double &r2)
+{
+    constexpr size_t lanes = 8;
+    double a0[lanes] = {}, a1[lanes] = {}, a2[lanes] = {};
+    size_t x = x0;
+
+    for (; x + lanes <= x1; x += lanes) {
+        for (size_t l = 0; l < lanes; l++) {
+            double p = double(row[x + l]);
+            double v = p > threshold ? p - background : 0.;
+            double xf = double(x + l);
+
+            a0[l] += v;
+            a1[l] += v * xf;
+            a2[l] += v * xf * xf;
+        }
+    }
+
+    for (; x < x1; x++) {
+        double p = double(row[x]);
+        double v = p > threshold ? p - background : 0.;
+        double xf = double(x);
+
+        a0[0] += v;
+        a1[0] += v * xf;
+        a2[0] += v * xf * xf;
+    }
+
+    r0 = r1 = r2 = 0;
+    for (size_t l = 0; l < lanes; l++) {
+        r0 += a0[l];
+        r1 += a1[l];
+        r2 += a2[l];
+    }
+}
+
+template<typename T>
+Sums window_sums(WorkerPool &pool, std::vector<Sums> &partial, const T *data,
+                 size_t width, size_t x0, size_t x1, size_t y0, size_t y1,
+                 double background, double threshold)
+{
+    std::fill(partial.begin(), partial.end(), Sums());
+
+    pool.parallel_for(y1 - y0, min_rows_per_chunk,
+                      [&](size_t chunk, size_t begin, size_t end) {
+        Sums sums;
+
+        for (size_t y = y0 + begin; y < y0 + end; y++) {
+            double r0, r1, r2, yf = double(y);
+
+            row_sums(data + y * width, x0, x1, background, threshold, r0, r1, r2);
+
+            sums.s0 += r0;
+            sums.sx += r1;
+            sums.sxx += r2;
+            sums.sy += yf * r0;
+            sums.syy += yf * yf * r0;
+            sums.sxy += yf * r1;
+        }
+
+        partial[chunk] = sums;
+    });
+
+    Sums total;
+    for (auto &sums : partial)
+        total.add(sums);
+
+    return total;
+}
+
+/* Mean and standard deviation of the pixels on the border of the frame,
+ * which are taken to be background */
+template<typename T>
+void border_stats(const T *data, size_t width, size_t height,
+                  double &mean, double &stddev)
+{
+    mean = stddev = 0;
+    if (width < 3 || height < 3)
+        return;
+
+    double sum = 0, sum2 = 0;
+    const T *last = data + (height - 1) * width;
+    auto add = [&](double v) {
+        sum += v;
+        sum2 += v * v;
+    };
+
+    for (size_t x = 0; x < width; x++) {
+        add(data[x]);
+        add(last[x]);
+    }
+
+    for (size_t y = 1; y < height - 1; y++) {
+        add(data[y * width]);
+        add(data[y * width + width - 1]);
+    }
+
+    const double n = double(2 * width + 2 * (height - 2));
+    mean = sum / n;
+    stddev = std::sqrt(std::max(sum2 / n - mean * mean, 0.));
+}
+
+void finish(BeamMoments &m, const Sums &sums)
+{
+    m.valid = sums.s0 > 0;
+    if (!m.valid)
+        return;
+
+    m.total = sums.s0;
+    m.centroid_x = sums.sx / sums.s0;
+    m.centroid_y = sums.sy / sums.s0;
+    m.sigma2_x = std::max(sums.sxx / sums.s0 - m.centroid_x * m.centroid_x, 0.);
+    m.sigma2_y = std::max(sums.syy / sums.s0 - m.centroid_y * m.centroid_y, 0.);
+    m.sigma2_xy = sums.sxy / sums.s0 - m.centroid_x * m.centroid_y;
+
+    /* ISO 11146-1, section 9 */
+    const double diff = m.sigma2_x - m.sigma2_y;
+    const double sum = m.sigma2_x + m.sigma2_y;
+    const double root = std::sqrt(diff * diff + 4 * m.sigma2_xy * m.sigma2_xy);
+    const double gamma = diff >= 0 ? 1. : -1.;
+
+    m.width_x = 2 * std::sqrt(2.) * std::sqrt(std::max(sum + gamma * root, 0.));
+    m.width_y = 2 * std::sqrt(2.) * std::sqrt(std::max(sum - gamma * root, 0.));
+    m.width_x_simple = 4 * std::sqrt(m.sigma2_x);
+    m.width_y_simple = 4 * std::sqrt(m.sigma2_y);
+
+    const double major = std::max(m.width_x, m.width_y);
+    m.ellipticity = major > 0 ? std::min(m.width_x, m.width_y) / major : 1.;
+
+    if (diff != 0)
+        m.azimuth = 0.5 * std::atan(2 * m.sigma2_xy / diff) * 180. / pi;
+    else
+        m.azimuth = m.sigma2_xy > 0 ? 45. : m.sigma2_xy < 0 ? -45. : 0.;
+}
+
+template<typename T>
+BeamMoments compute(WorkerPool &pool, const T *data, size_t width, size_t height)
+{
+    BeamMoments m = {};
+    std::vector<Sums> partial(pool.size());
+
+    double noise;
+    border_stats(data, width, height, m.background, noise);
+    const double threshold = m.background + noise_threshold * noise;
+
+    size_t x0 = 0, x1 = width, y0 = 0, y1 = height;
+
+    /* ISO 11146-3: shrink the integration area to three times the beam
+     * width around the centroid until it no longer changes, so that noise
+     * far from the beam does not inflate the second moments. The noise
+     * threshold keeps the first passes from being dominated by noise */
+    for (int i = 0; i < max_iterations; i++) {
+        finish(m, window_sums(pool, partial, data, width, x0, x1, y0, y1,
+                              m.background, threshold));
+        if (!m.valid)
+            break;
+
+        auto clamp = [](double v, size_t limit) {
+            return (size_t)std::clamp(v, 0., (double)limit);
+        };
+
+        const double half_x = 1.5 * std::max(m.width_x_simple, 1.);
+        const double half_y = 1.5 * std::max(m.width_y_simple, 1.);
+        size_t nx0 = clamp(std::floor(m.centroid_x - half_x), width);
+        size_t nx1 = clamp(std::ceil(m.centroid_x + half_x) + 1, width);
+        size_t ny0 = clamp(std::floor(m.centroid_y - half_y), height);
+        size_t ny1 = clamp(std::ceil(m.centroid_y + half_y) + 1, height);
+
+        if (nx0 == x0 && nx1 == x1 && ny0 == y0 && ny1 == y1)
+            break;
+
+        x0 = nx0;
+        x1 = nx1;
+        y0 = ny0;
+        y1 = ny1;
+    }
+
+    /* within the final area, the background-subtracted noise averages out,
+     * and thresholding would cut off the wings of the beam */
+    if (m.valid)
+        finish(m, window_sums(pool, partial, data, width, x0, x1, y0, y1,
+                              m.background,
+                              -std::numeric_limits<double>::infinity()));
+
+    return m;
+}
+
+}
+
+BeamMoments compute_moments(WorkerPool &pool, const epicsUInt8 *data,
+                            size_t width, size_t height)
+{
+    return compute(pool, data, width, height);
+}
+
+BeamMoments compute_moments(WorkerPool &pool, const epicsUInt16 *data,
+                            size_t width, size_t height)
+{
+    return compute(pool, data, width, height);
+}
@@ -0,0 +1,37 @@
+#ifndef TLBC2MOMENTS_H
+#define TLBC2MOMENTS_H
+
+#include <cstddef>
+
+#include <epicsTypes.h>
+
+class WorkerPool;
+
+/* Beam parameters from the first and second order moments of a frame, in
+ * pixels relative to the top left corner of the frame (ISO 11146-1/-3) */
+struct BeamMoments {
+    bool valid;             /* false if there is no signal above background */
+    double background;      /* subtracted from every pixel */
+    double total;           /* sum of the background-subtracted intensities */
+    double centroid_x;
+    double centroid_y;
+    double sigma2_x;        /* second order central moments */
+    double sigma2_y;
+    double sigma2_xy;
+    double width_x;         /* beam widths along the principal axes */
+    double width_y;
+    double width_x_simple;  /* 4 sigma along x and y, for round beams */
+    double width_y_simple;
+    double ellipticity;     /* minor / major width */
+    double azimuth;         /* principal axis angle to x, in degrees */
+};
+
+/* Computes the beam moments of a width x height frame on the pool's
+ * threads. The background is estimated from the frame's border pixels and
+ * subtracted; pixels within the background noise do not contribute */
+BeamMoments compute_moments(WorkerPool &pool, const epicsUInt8 *data,
+                            size_t width, size_t height);
+BeamMoments compute_moments(WorkerPool &pool, const epicsUInt16 *data,
+                            size_t width, size_t height);
+
+#endif /* TLBC2MOMENTS_H */
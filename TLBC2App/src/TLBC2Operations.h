@@ -0,0 +1,72 @@
+#ifndef TLBC2OPERATIONS_H
+#define TLBC2OPERATIONS_H
+
+#include <atomic>
+#include <functional>
+#include <string>
+
+#include <epicsEvent.h>
+#include <epicsThread.h>
+
+/* A thread for slow device operations, such as computing the ambient light
+ * correction, so that the asyn port does not wait for them.
+ *
+ * One operation runs at a time; start() refuses another until it returned.
+ * Operations report their own results, the runner only tells whether one
+ * is under way. */
+class OperationRunner: epicsThreadRunable {
+public:
+    explicit OperationRunner(const std::string &name)
+        : thread(*this, name.c_str(),
+                 epicsThreadGetStackSize(epicsThreadStackMedium),
+                 epicsThreadPriorityMedium)
+    {
+        thread.start();
+    }
+
+    ~OperationRunner()
+    {
+        exiting = true;
+        start_event.trigger();
+        /* the epicsThread destructor waits for the thread to exit */
+    }
+
+    /* Returns false if an operation is running already */
+    bool start(std::function<void()> op)
+    {
+        bool idle = false;
+        if (!running.compare_exchange_strong(idle, true))
+            return false;
+
+        operation = std::move(op);
+        start_event.trigger();
+        return true;
+    }
+
+    bool busy() const
+    {
+        return running;
+    }
+
+private:
+    void run() override
+    {
+        while (true) {
+            start_event.wait();
+            if (exiting)
+                return;
+
+            operation();
+            operation = nullptr;
+            running = false;
+        }
+    }
+
+    std::function<void()> operation;
+    std::atomic<bool> running{false};
+    std::atomic<bool> exiting{false};
+    epicsEvent start_event;
+    epicsThread thread;
+};
+
+#endif /* TLBC2OPERATIONS_H */
@@ -0,0 +1,292 @@
+#include <algorithm>
+#include <cmath>
+
+#include "TLBC2Profiles.h"
+#include "TLBC2Workers.h"
+
+namespace {
+
+constexpr double pi = 3.14159265358979323846;
+
+/* Rows per range handed to a worker; smaller frames are not worth waking
+ * the pool for */
+constexpr size_t min_rows_per_chunk = 64;
+
+/* Angles closer to 0 than this, in degrees, project along the axes */
+constexpr double min_angle = 1e-3;
+
+/* Samples below this fraction of the peak are left out of the fit, where
+ * the logarithm is dominated by noise */
+constexpr double fit_threshold = 0.1;
+
+/* Adds a row to the column sums and returns its own sum. The pixels are
+ * spread over independent accumulators so that the compiler can keep them
+ * in vector registers without reordering floating point additions */
+template<typename T>
+inline double add_row(const T *row, size_t width, double *columns)
+{
+    constexpr size_t lanes = 8;
+    double acc[lanes] = {};
+    size_t x = 0;
+
+    for (; x + lanes <= width; x += lanes) {
+        for (size_t l = 0; l < lanes; l++) {
+            const double v = double(row[x + l]);
+
+            columns[x + l] += v;
+            acc[l] += v;
+        }
+    }
+
+    for (; x < width; x++) {
+        const double v = double(row[x]);
+
+        columns[x] += v;
+        acc[0] += v;
+    }
+
+    double sum = 0;
+    for (size_t l = 0; l < lanes; l++)
+        sum += acc[l];
+    return sum;
+}
+
+/* Length of the part of the line (a, b) + t (da, db) inside the rectangle
+ * |x| <= half_w, |y| <= half_h, with (da, db) a unit vector */
+double chord(double a, double b, double da, double db, double half_w, double half_h)
+{
+    double t0 = -HUGE_VAL, t1 = HUGE_VAL;
+
+    auto clip = [&](double p, double dp, double half) {
+        if (std::fabs(dp) < 1e-12) {
+            if (std::fabs(p) > half)
+                t1 = t0;
+            return;
+        }
+        const double ta = (-half - p) / dp, tb = (half - p) / dp;
+        t0 = std::max(t0, std::min(ta, tb));
+        t1 = std::min(t1, std::max(ta, tb));
+    };
+
+    clip(a, da, half_w);
+    clip(b, db, half_h);
+    return std::max(t1 - t0, 0.);
+}
+
+/* Determinant of the symmetric 3x3 matrix a b c / b d e / c e f */
+double det3(double a, double b, double c, double d, double e, double f)
+{
+    return a * (d * f - e * e) - b * (b * f - e * c) + c * (b * e - d * c);
+}
+
+} // namespace
+
+template<typename T>
+void ProfileProjector::project_axes(WorkerPool &pool, const T *data, size_t width,
+                                    size_t height)
+{
+    profile_y.resize(height);
+    for (auto &partial : partial_x)
+        partial.assign(width, 0.);
+
+    pool.parallel_for(height, min_rows_per_chunk, [&](size_t chunk, size_t begin, size_t end) {
+        double *columns = partial_x[chunk].data();
+
+        for (size_t y = begin; y < end; y++)
+            profile_y[y] = add_row(data + y * width, width, columns);
+    });
+
+    profile_x.assign(width, 0.);
+    for (const auto &columns : partial_x)
+        for (size_t x = 0; x < width; x++)
+            profile_x[x] += columns[x];
+
+    pixels_x.assign(width, double(height));
+    pixels_y.assign(height, double(width));
+}
+
+template<typename T>
+void ProfileProjector::project_rotated(WorkerPool &pool, const T *data, size_t width,
+                                       size_t height, double angle)
+{
+    const double c = std::cos(angle * pi / 180.), s = std::sin(angle * pi / 180.);
+    const double cx = (width - 1) / 2., cy = (height - 1) / 2.;
+
+    /* enough samples for the projections of the outermost pixel centers */
+    const size_t size_u = (size_t)std::ceil((width - 1) * std::fabs(c) +
+                                            (height - 1) * std::fabs(s)) + 1;
+    const size_t size_v = (size_t)std::ceil((width - 1) * std::fabs(s) +
+                                            (height - 1) * std::fabs(c)) + 1;
+
+    for (auto &partial : partial_x)
+        partial.assign(size_u, 0.);
+    for (auto &partial : partial_y)
+        partial.assign(size_v, 0.);
+
+    /* u = dx c + dy s and v = dy c - dx s about the center, offset to the
+     * middle of the profiles; stepping along a row adds c and -s. Each
+     * chunk scatters into its own profiles */
+    pool.parallel_for(height, min_rows_per_chunk, [&](size_t chunk, size_t begin, size_t end) {
+        double *pu = partial_x[chunk].data();
+        double *pv = partial_y[chunk].data();
+
+        for (size_t y = begin; y < end; y++) {
+            const T *row = data + y * width;
+            const double dy = y - cy;
+            double u = -cx * c + dy * s + size_u / 2.;
+            double v = dy * c + cx * s + size_v / 2.;
+
+            for (size_t x = 0; x < width; x++, u += c, v -= s) {
+                const double value = double(row[x]);
+
+                pu[std::min((size_t)std::max(u, 0.), size_u - 1)] += value;
+                pv[std::min((size_t)std::max(v, 0.), size_v - 1)] += value;
+            }
+        }
+    });
+
+    profile_x.assign(size_u, 0.);
+    for (const auto &partial : partial_x)
+        for (size_t i = 0; i < size_u; i++)
+            profile_x[i] += partial[i];
+
+    profile_y.assign(size_v, 0.);
+    for (const auto &partial : partial_y)
+        for (size_t i = 0; i < size_v; i++)
+            profile_y[i] += partial[i];
+
+    /* the lengths of the lines through the frame at the sample centers */
+    pixels_x.resize(size_u);
+    for (size_t i = 0; i < size_u; i++)
+        pixels_x[i] = chord((i + 0.5 - size_u / 2.) * c, (i + 0.5 - size_u / 2.) * s,
+                            -s, c, width / 2., height / 2.);
+
+    pixels_y.resize(size_v);
+    for (size_t i = 0; i < size_v; i++)
+        pixels_y[i] = chord(-(i + 0.5 - size_v / 2.) * s, (i + 0.5 - size_v / 2.) * c,
+                            c, s, width / 2., height / 2.);
+}
+
+template<typename T>
+void ProfileProjector::project_frame(WorkerPool &pool, const T *data, size_t width,
+                                     size_t height, double angle)
+{
+    partial_x.resize(pool.size());
+    partial_y.resize(pool.size());
+
+    if (std::fabs(angle) < min_angle)
+        project_axes(pool, data, width, height);
+    else
+        project_rotated(pool, data, width, height, angle);
+}
+
+void ProfileProjector::project(WorkerPool &pool, const epicsUInt8 *data, size_t width,
+                               size_t height, double angle)
+{
+    project_frame(pool, data, width, height, angle);
+}
+
+void ProfileProjector::project(WorkerPool &pool, const epicsUInt16 *data, size_t width,
+                               size_t height, double angle)
+{
+    project_frame(pool, data, width, height, angle);
+}
+
+void ProfileProjector::project(WorkerPool &pool, const epicsUInt32 *data, size_t width,
+                               size_t height, double angle)
+{
+    project_frame(pool, data, width, height, angle);
+}
+
+GaussianFit fit_gaussian(const double *profile, const double *pixels, size_t size)
+{
+    GaussianFit fit = {};
+    if (size < 5)
+        return fit;
+
+    const size_t edge = std::max<size_t>(size / 20, 1);
+    double edge_sum = 0, edge_pixels = 0;
+    for (size_t i = 0; i < edge; i++) {
+        edge_sum += profile[i] + profile[size - 1 - i];
+        edge_pixels += pixels[i] + pixels[size - 1 - i];
+    }
+    const double background = edge_pixels > 0 ? edge_sum / edge_pixels : 0;
+
+    /* the profile without the background */
+    auto signal = [&](size_t i) {
+        return profile[i] - background * pixels[i];
+    };
+
+    size_t peak = 0;
+    for (size_t i = 1; i < size; i++)
+        if (signal(i) > signal(peak))
+            peak = i;
+
+    const double top = signal(peak);
+    if (top <= 0)
+        return fit;
+
+    size_t lo = peak, hi = peak;
+    while (lo > 0 && signal(lo - 1) > fit_threshold * top)
+        lo--;
+    while (hi + 1 < size && signal(hi + 1) > fit_threshold * top)
+        hi++;
+    if (hi - lo < 2)
+        return fit;
+
+    /* ln(p) = a + b t + c t^2 with t relative to the peak, weighted by p^2
+     * so that the noisy wings count less (Guo 2011) */
+    double s0 = 0, s1 = 0, s2 = 0, s3 = 0, s4 = 0, r0 = 0, r1 = 0, r2 = 0;
+    for (size_t i = lo; i <= hi; i++) {
+        const double p = signal(i);
+        const double t = double(i) - double(peak);
+        const double w = p * p, l = w * std::log(p);
+
+        s0 += w;
+        s1 += w * t;
+        s2 += w * t * t;
+        s3 += w * t * t * t;
+        s4 += w * t * t * t * t;
+        r0 += l;
+        r1 += l * t;
+        r2 += l * t * t;
+    }
+
+    const double det = det3(s0, s1, s2, s2, s3, s4);
+    if (det == 0)
+        return fit;
+
+    const double a = (r0 * (s2 * s4 - s3 * s3) - s1 * (r1 * s4 - s3 * r2) +
+                      s2 * (r1 * s3 - s2 * r2)) / det;
+    const double b = (s0 * (r1 * s4 - s3 * r2) - r0 * (s1 * s4 - s3 * s2) +
+                      s2 * (s1 * r2 - r1 * s2)) / det;
+    const double c = (s0 * (s2 * r2 - r1 * s3) - s1 * (s1 * r2 - r1 * s2) +
+                      r0 * (s1 * s3 - s2 * s2)) / det;
+    if (!(c < 0))
+        return fit;
+
+    const double sigma = std::sqrt(-1 / (2 * c));
+    fit.center = peak - b / (2 * c);
+    fit.amplitude = std::exp(a - b * b / (4 * c));
+    fit.width = 4 * sigma;
+    fit.background = background;
+
+    double mean = 0;
+    for (size_t i = 0; i < size; i++)
+        mean += profile[i];
+    mean /= size;
+
+    double ss_res = 0, ss_tot = 0;
+    for (size_t i = 0; i < size; i++) {
+        const double d = (i - fit.center) / sigma;
+        const double model = background * pixels[i] + fit.amplitude * std::exp(-0.5 * d * d);
+
+        ss_res += (profile[i] - model) * (profile[i] - model);
+        ss_tot += (profile[i] - mean) * (profile[i] - mean);
+    }
+    fit.rating = ss_tot > 0 ? 1 - ss_res / ss_tot : 0;
+
+    fit.valid = std::isfinite(fit.center) && std::isfinite(fit.amplitude) &&
+        fit.center >= 0 && fit.center <= size - 1;
+    return fit;
+}
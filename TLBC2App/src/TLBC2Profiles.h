@@ -0,0 +1,68 @@
+#ifndef TLBC2PROFILES_H
+#define TLBC2PROFILES_H
+
+#include <cstddef>
+#include <vector>
+
+#include <epicsTypes.h>
+
+class WorkerPool;
+
+/* a * exp(-2 (x - center)^2 / (width / 2)^2) plus the background fitted
+ * to a profile, in profile samples */
+struct GaussianFit {
+    bool valid;         /* false if the profile has no peak to fit */
+    double amplitude;
+    double center;
+    double width;       /* 1/e^2 diameter, 4 sigma */
+    double background;  /* per pixel */
+    double rating;      /* coefficient of determination, 1 for a perfect fit */
+};
+
+/* The X and Y projections of frames: the sums of the pixels along each
+ * column and row, or along lines rotated by an angle. Keeps its buffers
+ * between frames */
+class ProfileProjector {
+public:
+    /* Projects a width x height frame onto axes rotated by angle degrees
+     * from x towards y about the center of the frame, in one pass split
+     * over the pool. At 0 degrees x has width and y height values; at other
+     * angles each has as many as the frame is long along its axis, with the
+     * frame's center in the middle */
+    void project(WorkerPool &pool, const epicsUInt8 *data, size_t width, size_t height,
+                 double angle);
+    void project(WorkerPool &pool, const epicsUInt16 *data, size_t width, size_t height,
+                 double angle);
+    void project(WorkerPool &pool, const epicsUInt32 *data, size_t width, size_t height,
+                 double angle);
+
+    const std::vector<double> &x() const { return profile_x; }
+    const std::vector<double> &y() const { return profile_y; }
+
+    /* The number of pixels summed into each sample, which varies along
+     * rotated profiles */
+    const std::vector<double> &pixelsX() const { return pixels_x; }
+    const std::vector<double> &pixelsY() const { return pixels_y; }
+
+private:
+    template<typename T>
+    void project_frame(WorkerPool &pool, const T *data, size_t width, size_t height,
+                       double angle);
+    template<typename T>
+    void project_axes(WorkerPool &pool, const T *data, size_t width, size_t height);
+    template<typename T>
+    void project_rotated(WorkerPool &pool, const T *data, size_t width, size_t height,
+                         double angle);
+
+    std::vector<double> profile_x, profile_y;
+    std::vector<double> pixels_x, pixels_y;
+    std::vector<std::vector<double>> partial_x, partial_y;  /* per pool chunk */
+};
+
+/* Fits a Gaussian to the part of a profile above a tenth of its peak with
+ * Guo's weighted least squares on the logarithm, which needs no initial
+ * guess or iterations. The background per pixel is taken from the outer
+ * twentieths of the profile, and pixels gives the pixels in each sample */
+GaussianFit fit_gaussian(const double *profile, const double *pixels, size_t size);
+
+#endif /* TLBC2PROFILES_H */
@@ -0,0 +1,54 @@
+#ifndef TLBC2RING_H
+#define TLBC2RING_H
+
+#include <atomic>
+#include <cstddef>
+
+/* A lock-free ring buffer of N items for exactly one producer and one
+ * consumer thread. N must be a power of two */
+template<typename T, size_t N>
+class SpscRing {
+    static_assert(N && (N & (N - 1)) == 0, "N must be a power of two");
+
+    T items[N];
+    /* free-running counters, the slot is the counter modulo N */
+    std::atomic<size_t> head{0};    /* next item to pop, owned by the consumer */
+    std::atomic<size_t> tail{0};    /* next slot to push, owned by the producer */
+
+public:
+    static constexpr size_t capacity = N;
+
+    /* Producer side. Returns false and drops the item if the ring is full */
+    bool push(const T &item)
+    {
+        const size_t t = tail.load(std::memory_order_relaxed);
+
+        if (t - head.load(std::memory_order_acquire) == N)
+            return false;
+
+        items[t % N] = item;
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    /* Consumer side. Returns false if the ring is empty */
+    bool pop(T &item)
+    {
+        const size_t h = head.load(std::memory_order_relaxed);
+
+        if (h == tail.load(std::memory_order_acquire))
+            return false;
+
+        item = items[h % N];
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+    size_t size() const
+    {
+        return tail.load(std::memory_order_acquire) -
+               head.load(std::memory_order_acquire);
+    }
+};
+
+#endif /* TLBC2RING_H */
@@ -0,0 +1,137 @@
+#ifndef TLBC2SCHEDULER_H
+#define TLBC2SCHEDULER_H
+
+#include <algorithm>
+#include <deque>
+
+#include <epicsEvent.h>
+#include <epicsGuard.h>
+#include <epicsMutex.h>
+#include <epicsTime.h>
+
+#include <visa.h>
+
+/* Owns the device session and serializes every SDK call made with it.
+ *
+ * Commands run on the caller's thread, but only one at a time. When the
+ * device becomes free it is handed directly to the longest waiter of the
+ * highest waiting priority: priorities are strict, so operator writes go
+ * ahead of housekeeping reads, and waiters of one priority go in the order
+ * they arrived. A caller that submits again after its command does not
+ * overtake a waiter of the same or a higher priority, but as long as
+ * higher priority commands keep arriving, lower ones wait. */
+class DeviceScheduler {
+public:
+    enum Priority {
+        Control,        /* writes requested by clients */
+        Acquisition,    /* frame capture */
+        Housekeeping,   /* periodic and readback reads */
+        NumPriorities
+    };
+
+    struct Stats {
+        unsigned long count;
+        double mean_wait;   /* seconds */
+        double max_wait;    /* seconds */
+    };
+
+    void attach(ViSession vi)
+    {
+        session = vi;
+    }
+
+    /* Runs function(session) with exclusive access to the device and
+     * returns its result. Exceptions propagate after the device is freed */
+    template<typename F>
+    auto execute(Priority priority, F &&function)
+    {
+        acquire(priority);
+
+        struct Releaser {
+            DeviceScheduler &scheduler;
+            ~Releaser() { scheduler.release(); }
+        } releaser{*this};
+
+        return function(session);
+    }
+
+    Stats stats(Priority priority)
+    {
+        epicsGuard<epicsMutex> guard(mutex);
+        const Accumulator &acc = waits[priority];
+
+        return {acc.count, acc.count ? acc.total / acc.count : 0., acc.max};
+    }
+
+    void reset_stats()
+    {
+        epicsGuard<epicsMutex> guard(mutex);
+
+        for (auto &acc : waits)
+            acc = {};
+    }
+
+private:
+    struct Accumulator {
+        unsigned long count;
+        double total;
+        double max;
+    };
+
+    ViSession session = VI_NULL;
+
+    struct Waiter {
+        epicsEvent wakeup;
+        bool granted = false;
+    };
+
+    epicsMutex mutex;
+    bool busy = false;
+    std::deque<Waiter *> waiters[NumPriorities];
+    Accumulator waits[NumPriorities] = {};
+
+    void acquire(Priority priority)
+    {
+        epicsUInt64 start = epicsMonotonicGet();
+        epicsGuard<epicsMutex> guard(mutex);
+
+        if (busy) {
+            Waiter waiter;
+            waiters[priority].push_back(&waiter);
+
+            /* release() passes ownership on by setting granted, so busy
+             * stays set and nobody can barge in meanwhile */
+            while (!waiter.granted) {
+                epicsGuardRelease<epicsMutex> unguard(guard);
+                waiter.wakeup.wait();
+            }
+        }
+
+        busy = true;
+
+        Accumulator &acc = waits[priority];
+        double wait = (epicsMonotonicGet() - start) * 1e-9;
+        acc.count++;
+        acc.total += wait;
+        acc.max = std::max(acc.max, wait);
+    }
+
+    void release()
+    {
+        epicsGuard<epicsMutex> guard(mutex);
+
+        for (auto &queue : waiters) {
+            if (!queue.empty()) {
+                Waiter *waiter = queue.front();
+                queue.pop_front();
+                waiter->granted = true;
+                waiter->wakeup.trigger();
+                return;
+            }
+        }
+
+        busy = false;
+    }
+};
+
+#endif /* TLBC2SCHEDULER_H */
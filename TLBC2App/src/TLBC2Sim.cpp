@@ -0,0 +1,749 @@
+/* Simulated implementation of the subset of the TLBC2 API used by the
+ * driver, so that it can run without a beam profiler (and without the
+ * Windows-only SDK). Every simulated device renders an elliptical Gaussian
+ * beam with sensor noise and a slowly drifting centre, and reports
+ * TLBC1_Calculations derived from the beam model rather than measured. */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <epicsGuard.h>
+#include <epicsMutex.h>
+#include <epicsThread.h>
+#include <epicsTime.h>
+#include <iocsh.h>
+
+#include <visa.h>
+#include <TLBC2.h>
+#include <TLBC1_Calculations.h>
+
+#include "TLBC2Sim.h"
+
+namespace {
+
+/* Errors specific to the simulator, the rest reuse VISA codes */
+constexpr ViStatus SIM_ERROR_NO_MEASUREMENT = VI_ERROR + 0x1000;
+constexpr ViStatus SIM_ERROR_DEVICE_IN_USE = VI_ERROR + 0x1001;
+constexpr ViStatus SIM_ERROR_NOT_CORRECTED = VI_ERROR + 0x1002;
+
+/* Same meaning as the driver's ambient_light_correction_status */
+enum { SIM_CORRECTION_AVAILABLE, SIM_CORRECTION_NEVER_RUN };
+
+constexpr double pi = 3.14159265358979323846;
+constexpr double pixel_pitch_um = 3.45;
+constexpr double ambient_correction_time = 2.;
+
+struct SimConfig {
+    int num_devices = 1;
+    int width = TLBC1_MAX_COLUMNS;
+    int height = TLBC1_MAX_ROWS;
+    int bit_depth = 12;
+    double call_latency = 0.;   /* seconds added to every call */
+    double ellipticity = 1.;    /* ratio of the beam's Y and X widths */
+};
+
+SimConfig config;
+
+/* xorshift64*: plenty for sensor noise, and much cheaper than <random>
+ * when rendering 12 MP per frame */
+class Rng {
+    uint64_t state;
+
+public:
+    explicit Rng(uint64_t seed): state(seed ? seed : 0x9e3779b97f4a7c15ull) {}
+
+    uint64_t next()
+    {
+        state ^= state >> 12;
+        state ^= state << 25;
+        state ^= state >> 27;
+        return state * 0x2545f4914f6cdd1dull;
+    }
+
+    double uniform()
+    {
+        return (next() >> 11) * (1. / 9007199254740992.);
+    }
+
+    /* Irwin-Hall approximation of a standard normal distribution */
+    double normal()
+    {
+        return (uniform() + uniform() + uniform() + uniform() - 2.) * std::sqrt(3.);
+    }
+};
+
+struct SimDevice {
+    epicsMutex lock;
+    std::string serial_number;
+    std::string resource_name;
+    bool open = false;
+    Rng rng;
+
+    ViReal64 exposure_time, gain, attenuation, clip_level, auto_clip_level, wavelength;
+    ViBoolean auto_exposure;
+    ViUInt8 ambient_mode, ambient_status;
+    ViBoolean calc_automatic;
+    ViUInt8 calc_form;
+    ViUInt16 roi_left, roi_top, roi_width, roi_height;
+
+    /* beam model, in sensor pixels */
+    double beam_x, beam_y, sigma_x, sigma_y;
+    double peak;
+    double drift_phase = 0.;
+
+    bool measured = false;
+    TLBC1_Calculations calcs;
+
+    SimDevice(int index)
+        : serial_number("SIM" + std::to_string(1000 + index)),
+          resource_name("SIM::TLBC2::" + std::to_string(index)),
+          rng(index + 1)
+    {
+        reset();
+    }
+
+    void reset()
+    {
+        exposure_time = 0.1;
+        gain = 0.;
+        attenuation = 0.;
+        clip_level = 0.135;
+        auto_clip_level = 0.01;
+        wavelength = 633.;
+        auto_exposure = VI_FALSE;
+        ambient_mode = 0;
+        ambient_status = SIM_CORRECTION_NEVER_RUN;
+        calc_automatic = VI_TRUE;
+        calc_form = 0;
+        roi_left = roi_top = 0;
+        roi_width = config.width;
+        roi_height = config.height;
+
+        beam_x = config.width / 2.;
+        beam_y = config.height / 2.;
+        sigma_x = std::min(config.width, config.height) / 24.;
+        sigma_y = sigma_x * config.ellipticity;
+        measured = false;
+        calcs = {};
+    }
+
+    double full_scale() const
+    {
+        return (1 << config.bit_depth) - 1;
+    }
+
+    double base_level() const
+    {
+        return full_scale() * 0.01;
+    }
+
+    double noise_level() const
+    {
+        return full_scale() * 0.002;
+    }
+
+    void measure()
+    {
+        /* random walk around a slow oscillation of the pointing */
+        drift_phase += 0.01;
+        beam_x += rng.normal() * 0.2 + std::sin(drift_phase) * 0.5;
+        beam_y += rng.normal() * 0.2 + std::cos(drift_phase * 0.7) * 0.5;
+        beam_x = std::clamp(beam_x, 0., (double)config.width - 1);
+        beam_y = std::clamp(beam_y, 0., (double)config.height - 1);
+
+        /* exposure of 0.1s without gain or attenuation reaches 60% of the
+         * dynamic range */
+        peak = full_scale() * 0.6 * (exposure_time / 0.1) *
+            std::pow(10., gain / 20.) * std::pow(10., -attenuation / 10.);
+        peak *= 1. + rng.normal() * 0.005;
+
+        update_calculations();
+
+        /* like the SDK, auto exposure only moves part of the way towards
+         * its target on each measurement */
+        if (auto_exposure) {
+            double level = std::min(peak, full_scale()) / full_scale();
+            double factor = std::clamp(std::sqrt(0.7 / std::max(level, 1e-3)), 0.5, 2.);
+            exposure_time = std::clamp(exposure_time * factor, 2.8e-5, 0.5);
+        }
+
+        measured = true;
+    }
+
+    void update_calculations()
+    {
+        TLBC1_Calculations &c = calcs;
+        double cx = beam_x - roi_left;
+        double cy = beam_y - roi_top;
+        double level = std::min(peak, full_scale());
+        double clip = 2. * std::sqrt(2. * std::log(1. / clip_level));
+
+        c = {};
+        c.isValid = cx >= 0 && cy >= 0 && cx < roi_width && cy < roi_height &&
+            level > 4 * noise_level();
+
+        c.baseLevel = base_level();
+        c.lightShieldedPixelMeanIntensity = base_level();
+        c.saturation = level / full_scale();
+        c.peakPositionX = (ViUInt16)std::clamp(cx, 0., roi_width - 1.);
+        c.peakPositionY = (ViUInt16)std::clamp(cy, 0., roi_height - 1.);
+        c.centroidPositionX = (ViReal32)cx;
+        c.centroidPositionY = (ViReal32)cy;
+
+        c.beamWidthIsoX = 4. * sigma_x;
+        c.beamWidthIsoY = 4. * sigma_y;
+        c.beamWidthIsoXSimple = c.beamWidthIsoX;
+        c.beamWidthIsoYSimple = c.beamWidthIsoY;
+        c.beamWidthClipX = (ViReal32)(clip * sigma_x);
+        c.beamWidthClipY = (ViReal32)(clip * sigma_y);
+        c.ellipticityIso = std::min(sigma_x, sigma_y) / std::max(sigma_x, sigma_y);
+        c.azimuthAngle = 0.;
+
+        c.ellipseDiaMin = (ViReal32)(4. * std::min(sigma_x, sigma_y));
+        c.ellipseDiaMax = (ViReal32)(4. * std::max(sigma_x, sigma_y));
+        c.ellipseDiaMean = (c.ellipseDiaMin + c.ellipseDiaMax) / 2;
+        c.ellipseOrientation = sigma_x >= sigma_y ? 0.f : 90.f;
+        c.ellipseEllipticity = (ViReal32)c.ellipticityIso;
+        c.ellipseEccentricity = (ViReal32)std::sqrt(1. - c.ellipticityIso * c.ellipticityIso);
+        c.ellipseCenterX = (ViReal32)cx;
+        c.ellipseCenterY = (ViReal32)cy;
+        c.ellipseWidthIsoX = (ViReal32)c.beamWidthIsoX;
+        c.ellipseWidthIsoY = (ViReal32)c.beamWidthIsoY;
+
+        double area_um2 = 2. * pi * sigma_x * sigma_y * pixel_pitch_um * pixel_pitch_um;
+        double power_mw = peak * 1e-4 * 2. * pi * sigma_x * sigma_y / exposure_time * 1e-6;
+        c.totalPower = (ViReal32)(10. * std::log10(std::max(power_mw, 1e-12)));
+        c.peakPowerDensity = (ViReal32)(power_mw / area_um2);
+
+        c.gaussianFitCentroidPositionX = (ViReal32)cx;
+        c.gaussianFitCentroidPositionY = (ViReal32)cy;
+        c.gaussianFitRatingX = 0.98f;
+        c.gaussianFitRatingY = 0.98f;
+        c.gaussianFitDiameterX = (ViReal32)c.beamWidthIsoX;
+        c.gaussianFitDiameterY = (ViReal32)c.beamWidthIsoY;
+
+        /* automatic calculation area: three times the beam width */
+        c.calcAreaCenterX = (ViReal32)cx;
+        c.calcAreaCenterY = (ViReal32)cy;
+        c.calcAreaWidth = (ViReal32)std::min(3. * c.beamWidthIsoX, (double)roi_width);
+        c.calcAreaHeight = (ViReal32)std::min(3. * c.beamWidthIsoY, (double)roi_height);
+        c.calcAreaAngle = 0.;
+        c.calcAreaLineOffset = c.calcAreaWidth;
+
+        c.profilePeakValueX = (ViReal32)(level + base_level());
+        c.profilePeakValueY = (ViReal32)(level + base_level());
+        c.profilePeakPosX = c.peakPositionX;
+        c.profilePeakPosY = c.peakPositionY;
+
+        c.effectiveArea = area_um2;
+        c.effectiveBeamDiameter = std::sqrt(4. * area_um2 / pi);
+
+        c.temperature = temperature();
+    }
+
+    double temperature()
+    {
+        epicsTimeStamp now;
+        epicsTimeGetCurrent(&now);
+        return 30. + 0.5 * std::sin(now.secPastEpoch / 600.) + rng.normal() * 0.02;
+    }
+
+    template<typename T>
+    void render(T *image)
+    {
+        const double base = base_level();
+        const double noise = noise_level();
+        const double max = full_scale();
+        std::vector<double> profile_x(roi_width), profile_y(roi_height);
+
+        /* the beam is separable, so only the two profiles need exp() */
+        for (size_t x = 0; x < roi_width; x++) {
+            double d = (roi_left + x - beam_x) / sigma_x;
+            profile_x[x] = std::exp(-0.5 * d * d);
+        }
+        for (size_t y = 0; y < roi_height; y++) {
+            double d = (roi_top + y - beam_y) / sigma_y;
+            profile_y[y] = peak * std::exp(-0.5 * d * d);
+        }
+
+        for (size_t y = 0; y < roi_height; y++) {
+            T *row = image + y * roi_width;
+            double amplitude = profile_y[y];
+
+            for (size_t x = 0; x < roi_width; x += 4) {
+                uint64_t bits = rng.next();
+
+                for (size_t i = x; i < std::min<size_t>(x + 4, roi_width); i++) {
+                    double n = ((bits & 0xffff) / 32768. - 1.) * noise;
+                    double value = base + amplitude * profile_x[i] + n;
+
+                    row[i] = (T)std::clamp(value, 0., max);
+                    bits >>= 16;
+                }
+            }
+        }
+    }
+};
+
+epicsMutex devices_lock;
+std::vector<std::unique_ptr<SimDevice>> devices;
+
+void simulate_latency()
+{
+    if (config.call_latency > 0)
+        epicsThreadSleep(config.call_latency);
+}
+
+void create_devices()
+{
+    epicsGuard<epicsMutex> guard(devices_lock);
+
+    if (devices.empty()) {
+        for (int i = 0; i < config.num_devices; i++)
+            devices.push_back(std::make_unique<SimDevice>(i));
+    }
+}
+
+template<typename F>
+ViStatus with_device(ViSession vi, F &&function)
+{
+    simulate_latency();
+
+    SimDevice *dev = nullptr;
+    {
+        epicsGuard<epicsMutex> guard(devices_lock);
+        if (vi >= 1 && vi <= devices.size() && devices[vi - 1]->open)
+            dev = devices[vi - 1].get();
+    }
+
+    if (!dev)
+        return VI_ERROR_INV_OBJECT;
+
+    epicsGuard<epicsMutex> guard(dev->lock);
+    return function(*dev);
+}
+
+template<typename T>
+ViStatus set_in_range(T &setting, T value, T min, T max)
+{
+    if (value < min || value > max)
+        return VI_ERROR_PARAMETER2;
+
+    setting = value;
+    return VI_SUCCESS;
+}
+
+} // namespace
+
+ViStatus TLBC2_get_device_count(ViSession vi, ViUInt32 *deviceCount)
+{
+    simulate_latency();
+    create_devices();
+    *deviceCount = devices.size();
+    return VI_SUCCESS;
+}
+
+ViStatus TLBC2_get_device_information(ViSession vi, ViUInt32 deviceIndex,
+                                      ViChar manufacturer[], ViChar modelName[],
+                                      ViChar serialNumber[], ViBoolean *deviceAvailable,
+                                      ViChar resourceName[])
+{
+    simulate_latency();
+    create_devices();
+
+    epicsGuard<epicsMutex> guard(devices_lock);
+    if (deviceIndex >= devices.size())
+        return VI_ERROR_PARAMETER2;
+
+    const SimDevice &dev = *devices[deviceIndex];
+    strcpy(manufacturer, "Thorlabs (simulated)");
+    strcpy(modelName, "BC210 simulator");
+    strcpy(serialNumber, dev.serial_number.c_str());
+    strcpy(resourceName, dev.resource_name.c_str());
+    *deviceAvailable = dev.open ? VI_FALSE : VI_TRUE;
+
+    return VI_SUCCESS;
+}
+
+ViStatus TLBC2_init(ViRsrc resourceName, ViBoolean IDQuery, ViBoolean resetDevice,
+                    ViSession *vi)
+{
+    simulate_latency();
+    create_devices();
+
+    epicsGuard<epicsMutex> guard(devices_lock);
+    for (size_t i = 0; i < devices.size(); i++) {
+        SimDevice &dev = *devices[i];
+
+        if (dev.resource_name != resourceName)
+            continue;
+        if (dev.open)
+            return SIM_ERROR_DEVICE_IN_USE;
+
+        if (resetDevice)
+            dev.reset();
+        dev.open = true;
+        *vi = i + 1;
+        return VI_SUCCESS;
+    }
+
+    return VI_ERROR_RSRC_NFOUND;
+}
+
+ViStatus TLBC2_close(ViSession vi)
+{
+    return with_device(vi, [](SimDevice &dev) {
+        dev.open = false;
+        return VI_SUCCESS;
+    });
+}
+
+ViStatus TLBC2_revision_query(ViSession vi, ViChar instrumentDriverRevision[],
+                              ViChar firmwareRevision[])
+{
+    return with_device(vi, [&](SimDevice &) {
+        strcpy(instrumentDriverRevision, "TLBC2 simulator");
+        strcpy(firmwareRevision, "simulated");
+        return VI_SUCCESS;
+    });
+}
+
+ViStatus TLBC2_error_message(ViSession vi, ViStatus statusCode, ViChar description[])
+{
+    const char *message;
+
+    switch (statusCode) {
+        case VI_SUCCESS: message = "no error"; break;
+        case VI_ERROR_INV_OBJECT: message = "invalid session"; break;
+        case VI_ERROR_RSRC_NFOUND: message = "resource not found"; break;
+        case VI_ERROR_PARAMETER1:
+        case VI_ERROR_PARAMETER2: message = "parameter out of range"; break;
+        case SIM_ERROR_NO_MEASUREMENT: message = "no measurement was requested"; break;
+        case SIM_ERROR_DEVICE_IN_USE: message = "device is already in use"; break;
+        case SIM_ERROR_NOT_CORRECTED: message = "ambient light correction was never run"; break;
+        default: message = "unknown error"; break;
+    }
+
+    snprintf(description, TLBC2_ERR_DESCR_BUFFER_SIZE, "%s", message);
+    return VI_SUCCESS;
+}
+
+ViStatus TLBC2_get_exposure_time(ViSession vi, ViReal64 *exposureTime)
+{
+    return with_device(vi, [&](SimDevice &dev) {
+        *exposureTime = dev.exposure_time;
+        return VI_SUCCESS;
+    });
+}
+
+ViStatus TLBC2_set_exposure_time(ViSession vi, ViReal64 exposureTime)
+{
+    return with_device(vi, [&](SimDevice &dev) {
+        return set_in_range(dev.exposure_time, exposureTime, 2.8e-5, 0.5);
+    });
+}
+
+ViStatus TLBC2_get_exposure_time_range(ViSession vi, ViReal64 *minimum, ViReal64 *maximum)
+{
+    return with_device(vi, [&](SimDevice &) {
+        *minimum = 2.8e-5;
+        *maximum = 0.5;
+        return VI_SUCCESS;
+    });
+}
+
+ViStatus TLBC2_get_gain(ViSession vi, ViReal64 *gain)
+{
+    return with_device(vi, [&](SimDevice &dev) {
+        *gain = dev.gain;
+        return VI_SUCCESS;
+    });
+}
+
+ViStatus TLBC2_set_gain(ViSession vi, ViReal64 gain)
+{
+    return with_device(vi, [&](SimDevice &dev) {
+        return set_in_range(dev.gain, gain, 0., 12.);
+    });
+}
+
+ViStatus TLBC2_get_gain_range(ViSession vi, ViReal64 *minimum, ViReal64 *maximum)
+{
+    return with_device(vi, [&](SimDevice &) {
+        *minimum = 0.;
+        *maximum = 12.;
+        return VI_SUCCESS;
+    });
+}
+
+ViStatus TLBC2_get_temperature(ViSession vi, ViReal64 *temperature)
+{
+    return with_device(vi, [&](SimDevice &dev) {
+        *temperature = dev.temperature();
+        return VI_SUCCESS;
+    });
+}
+
+ViStatus TLBC2_get_attenuation(ViSession vi, ViReal64 *attenuation)
+{
+    return with_device(vi, [&](SimDevice &dev) {
+        *attenuation = dev.attenuation;
+        return VI_SUCCESS;
+    });
+}
+
+ViStatus TLBC2_set_attenuation(ViSession vi, ViReal64 attenuation)
+{
+    return with_device(vi, [&](SimDevice &dev) {
+        return set_in_range(dev.attenuation, attenuation, 0., 100.);
+    });
+}
+
+ViStatus TLBC2_get_auto_exposure(ViSession vi, ViBoolean *autoExposure)
+{
+    return with_device(vi, [&](SimDevice &dev) {
+        *autoExposure = dev.auto_exposure;
+        return VI_SUCCESS;
+    });
+}
+
+ViStatus TLBC2_set_auto_exposure(ViSession vi, ViBoolean autoExposure)
+{
+    return with_device(vi, [&](SimDevice &dev) {
+        dev.auto_exposure = autoExposure ? VI_TRUE : VI_FALSE;
+        return VI_SUCCESS;
+    });
+}
+
+ViStatus TLBC2_get_auto_calculation_area_clip_level(ViSession vi, ViReal64 *clipLevel)
+{
+    return with_device(vi, [&](SimDevice &dev) {
+        *clipLevel = dev.auto_clip_level;
+        return VI_SUCCESS;
+    });
+}
+
+ViStatus TLBC2_set_auto_calculation_area_clip_level(ViSession vi, ViReal64 clipLevel)
+{
+    return with_device(vi, [&](SimDevice &dev) {
+        return set_in_range(dev.auto_clip_level, clipLevel, 0., 1.);
+    });
+}
+
+ViStatus TLBC2_get_clip_level(ViSession vi, ViReal64 *clipLevel)
+{
+    return with_device(vi, [&](SimDevice &dev) {
+        *clipLevel = dev.clip_level;
+        return VI_SUCCESS;
+    });
+}
+
+ViStatus TLBC2_set_clip_level(ViSession vi, ViReal64 clipLevel)
+{
+    return with_device(vi, [&](SimDevice &dev) {
+        /* a clip level of 0 would make the clip width infinite */
+        return set_in_range(dev.clip_level, clipLevel, 1e-3, 1.);
+    });
+}
+
+ViStatus TLBC2_get_wavelength(ViSession vi, ViReal64 *wavelength)
+{
+    return with_device(vi, [&](SimDevice &dev) {
+        *wavelength = dev.wavelength;
+        return VI_SUCCESS;
+    });
+}
+
+ViStatus TLBC2_set_wavelength(ViSession vi, ViReal64 wavelength)
+{
+    return with_device(vi, [&](SimDevice &dev) {
+        return set_in_range(dev.wavelength, wavelength, 245., 1100.);
+    });
+}
+
+ViStatus TLBC2_get_wavelength_range(ViSession vi, ViReal64 *minimum, ViReal64 *maximum)
+{
+    return with_device(vi, [&](SimDevice &) {
+        *minimum = 245.;
+        *maximum = 1100.;
+        return VI_SUCCESS;
+    });
+}
+
+ViStatus TLBC2_get_ambient_light_correction_mode(ViSession vi, ViUInt8 *mode)
+{
+    return with_device(vi, [&](SimDevice &dev) {
+        *mode = dev.ambient_mode;
+        return VI_SUCCESS;
+    });
+}
+
+ViStatus TLBC2_set_ambient_light_correction_mode(ViSession vi, ViUInt8 mode)
+{
+    return with_device(vi, [&](SimDevice &dev) {
+        if (mode && dev.ambient_status != SIM_CORRECTION_AVAILABLE)
+            return SIM_ERROR_NOT_CORRECTED;
+
+        dev.ambient_mode = mode ? 1 : 0;
+        return VI_SUCCESS;
+    });
+}
+
+ViStatus TLBC2_get_ambient_light_correction_status(ViSession vi, ViUInt8 *status)
+{
+    return with_device(vi, [&](SimDevice &dev) {
+        *status = dev.ambient_status;
+        return VI_SUCCESS;
+    });
+}
+
+ViStatus TLBC2_run_ambient_light_correction(ViSession vi)
+{
+    return with_device(vi, [&](SimDevice &dev) {
+        epicsThreadSleep(ambient_correction_time);
+        dev.ambient_status = SIM_CORRECTION_AVAILABLE;
+        return VI_SUCCESS;
+    });
+}
+
+ViStatus TLBC2_get_calculation_area_mode(ViSession vi, ViBoolean *automatic, ViUInt8 *form)
+{
+    return with_device(vi, [&](SimDevice &dev) {
+        *automatic = dev.calc_automatic;
+        *form = dev.calc_form;
+        return VI_SUCCESS;
+    });
+}
+
+ViStatus TLBC2_set_calculation_area_mode(ViSession vi, ViBoolean automatic, ViUInt8 form)
+{
+    return with_device(vi, [&](SimDevice &dev) {
+        dev.calc_automatic = automatic;
+        dev.calc_form = form;
+        return VI_SUCCESS;
+    });
+}
+
+ViStatus TLBC2_set_user_calculation_area(ViSession vi, ViReal32 centerX, ViReal32 centerY,
+                                         ViReal32 width, ViReal32 height, ViReal64 angle)
+{
+    /* the simulated calculation area always follows the beam */
+    return with_device(vi, [](SimDevice &) {
+        return VI_SUCCESS;
+    });
+}
+
+ViStatus TLBC2_get_roi(ViSession vi, ViUInt16 *left, ViUInt16 *top,
+                       ViUInt16 *width, ViUInt16 *height)
+{
+    return with_device(vi, [&](SimDevice &dev) {
+        *left = dev.roi_left;
+        *top = dev.roi_top;
+        *width = dev.roi_width;
+        *height = dev.roi_height;
+        return VI_SUCCESS;
+    });
+}
+
+ViStatus TLBC2_set_roi(ViSession vi, ViUInt16 left, ViUInt16 top,
+                       ViUInt16 width, ViUInt16 height)
+{
+    /* clamp to the sensor like the SDK does, rather than failing */
+    return with_device(vi, [&](SimDevice &dev) {
+        constexpr int min_size = 16;
+
+        dev.roi_left = std::min<int>(left, config.width - min_size);
+        dev.roi_top = std::min<int>(top, config.height - min_size);
+        dev.roi_width = std::clamp<int>(width, min_size, config.width - dev.roi_left);
+        dev.roi_height = std::clamp<int>(height, min_size, config.height - dev.roi_top);
+        dev.measured = false;
+        return VI_SUCCESS;
+    });
+}
+
+ViStatus TLBC2_request_new_measurement(ViSession vi)
+{
+    return with_device(vi, [](SimDevice &dev) {
+        epicsThreadSleep(dev.exposure_time);
+        dev.measure();
+        return VI_SUCCESS;
+    });
+}
+
+ViStatus TLBC2_get_scan_data(ViSession vi, TLBC1_Calculations *scanData)
+{
+    return with_device(vi, [&](SimDevice &dev) {
+        if (!dev.measured)
+            return SIM_ERROR_NO_MEASUREMENT;
+
+        *scanData = dev.calcs;
+        return VI_SUCCESS;
+    });
+}
+
+ViStatus TLBC2_get_image(ViSession vi, ViUInt8 imageData[], ViUInt16 *width,
+                         ViUInt16 *height, ViUInt8 *bytesPerPixel)
+{
+    return with_device(vi, [&](SimDevice &dev) {
+        if (!dev.measured)
+            return SIM_ERROR_NO_MEASUREMENT;
+
+        if (config.bit_depth > 8) {
+            dev.render((ViUInt16 *)imageData);
+            *bytesPerPixel = 2;
+        } else {
+            dev.render(imageData);
+            *bytesPerPixel = 1;
+        }
+
+        *width = dev.roi_width;
+        *height = dev.roi_height;
+        return VI_SUCCESS;
+    });
+}
+
+static const iocshArg arg0 = {"numDevices", iocshArgInt};
+static const iocshArg arg1 = {"width", iocshArgInt};
+static const iocshArg arg2 = {"height", iocshArgInt};
+static const iocshArg arg3 = {"bitDepth", iocshArgInt};
+static const iocshArg arg4 = {"callLatency", iocshArgDouble};
+static const iocshArg arg5 = {"ellipticity", iocshArgDouble};
+
+static const iocshArg *const args[] = {&arg0, &arg1, &arg2, &arg3, &arg4, &arg5};
+
+static const iocshFuncDef configTLBC2Sim = {"TLBC2SimConfig", 6, args};
+static void configTLBC2SimCallFunc(const iocshArgBuf *args)
+{
+    {
+        epicsGuard<epicsMutex> guard(devices_lock);
+        if (!devices.empty()) {
+            fprintf(stderr, "TLBC2SimConfig: must be called before TLBC2Config\n");
+            return;
+        }
+    }
+
+    /* zero keeps the default */
+    if (args[0].ival > 0)
+        config.num_devices = args[0].ival;
+    if (args[1].ival > 0)
+        config.width = std::min(args[1].ival, TLBC1_MAX_COLUMNS);
+    if (args[2].ival > 0)
+        config.height = std::min(args[2].ival, TLBC1_MAX_ROWS);
+    if (args[3].ival > 0)
+        config.bit_depth = std::clamp(args[3].ival, 8, 16);
+    if (args[4].dval > 0)
+        config.call_latency = args[4].dval;
+    if (args[5].dval > 0)
+        config.ellipticity = args[5].dval;
+}
+
+void TLBC2SimRegister()
+{
+    iocshRegister(&configTLBC2Sim, configTLBC2SimCallFunc);
+}
@@ -0,0 +1,11 @@
+#ifndef TLBC2SIM_H
+#define TLBC2SIM_H
+
+/* Simulated TLBC2 backend, built instead of the vendor library when
+ * TLBC2_SIM = YES. It implements the TLBC2_* functions declared in
+ * sim/TLBC2.h; this header only exposes what is specific to the simulator. */
+
+/* Registers the TLBC2SimConfig iocsh command */
+void TLBC2SimRegister();
+
+#endif /* TLBC2SIM_H */
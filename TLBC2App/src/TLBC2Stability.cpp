@@ -0,0 +1,146 @@
+#include <algorithm>
+#include <cmath>
+
+#include "TLBC2Stability.h"
+
+void StabilityAccumulator::set_window(size_t window)
+{
+    window_size = window;
+    reset();
+}
+
+void StabilityAccumulator::reset()
+{
+    count = 0;
+    mean = m2 = 0;
+    samples.assign(window_size, 0.);
+    next = total = removed = 0;
+    min_candidates.clear();
+    max_candidates.clear();
+    all_min = all_max = 0;
+
+    for (auto &octave : octaves)
+        octave = Octave();
+}
+
+void StabilityAccumulator::add(double value)
+{
+    if (window_size) {
+        if (total >= window_size)
+            remove_window(samples[next]);
+
+        samples[next] = value;
+        next = (next + 1) % window_size;
+
+        /* drop candidates that left the window or can no longer be the
+         * extreme, then add the new sample */
+        const size_t oldest = total + 1 > window_size ? total + 1 - window_size : 0;
+        while (!min_candidates.empty() && min_candidates.front().first < oldest)
+            min_candidates.pop_front();
+        while (!max_candidates.empty() && max_candidates.front().first < oldest)
+            max_candidates.pop_front();
+        while (!min_candidates.empty() && min_candidates.back().second >= value)
+            min_candidates.pop_back();
+        while (!max_candidates.empty() && max_candidates.back().second <= value)
+            max_candidates.pop_back();
+        min_candidates.emplace_back(total, value);
+        max_candidates.emplace_back(total, value);
+    } else {
+        all_min = count ? std::min(all_min, value) : value;
+        all_max = count ? std::max(all_max, value) : value;
+    }
+
+    add_window(value);
+    total++;
+
+    /* removing samples from Welford's sums slowly accumulates rounding
+     * errors, so recompute them once per window length */
+    if (window_size && removed >= window_size)
+        refresh();
+
+    add_allan(value);
+}
+
+void StabilityAccumulator::add_window(double value)
+{
+    count++;
+    const double delta = value - mean;
+    mean += delta / count;
+    m2 += delta * (value - mean);
+}
+
+void StabilityAccumulator::remove_window(double value)
+{
+    removed++;
+    if (--count == 0) {
+        mean = m2 = 0;
+        return;
+    }
+
+    const double delta = value - mean;
+    mean -= delta / count;
+    m2 -= delta * (value - mean);
+}
+
+void StabilityAccumulator::refresh()
+{
+    count = 0;
+    mean = m2 = 0;
+    removed = 0;
+
+    for (double value : samples)
+        add_window(value);
+}
+
+void StabilityAccumulator::add_allan(double value)
+{
+    for (auto &octave : octaves) {
+        if (octave.has_previous) {
+            const double diff = value - octave.previous;
+
+            octave.sum_squares += diff * diff;
+            octave.differences++;
+        }
+        octave.previous = value;
+        octave.has_previous = true;
+
+        if (!octave.has_pending) {
+            octave.pending = value;
+            octave.has_pending = true;
+            return;
+        }
+
+        /* the block is complete, carry its average up an octave */
+        value = (octave.pending + value) / 2;
+        octave.has_pending = false;
+    }
+}
+
+StabilityAccumulator::Stats StabilityAccumulator::stats() const
+{
+    Stats stats = {count, mean, 0, 0, 0};
+
+    if (!count)
+        return stats;
+
+    stats.rms = std::sqrt(std::max(m2 / count, 0.));
+    if (window_size) {
+        stats.min = min_candidates.front().second;
+        stats.max = max_candidates.front().second;
+    } else {
+        stats.min = all_min;
+        stats.max = all_max;
+    }
+
+    return stats;
+}
+
+void StabilityAccumulator::allan_deviation(double adev[num_taus]) const
+{
+    for (size_t k = 0; k < num_taus; k++) {
+        const Octave &octave = octaves[k];
+
+        adev[k] = octave.differences ?
+            std::sqrt(octave.sum_squares / (2 * octave.differences)) : 0.;
+    }
+}
@@ -0,0 +1,78 @@
+#ifndef TLBC2STABILITY_H
+#define TLBC2STABILITY_H
+
+#include <cstddef>
+#include <deque>
+#include <utility>
+#include <vector>
+
+/* Streaming statistics of one per-frame value (e.g. the centroid X), for
+ * characterizing beam pointing stability without storing images.
+ *
+ * Mean, RMS deviation, min and max cover the last window() samples, or all
+ * samples since reset() if the window is 0. The Allan deviation always
+ * covers all samples since reset(), at averaging times of 1, 2, 4, ...
+ * samples. Adding a sample is O(1) (amortized) */
+class StabilityAccumulator {
+public:
+    static constexpr size_t num_taus = 16;
+
+    struct Stats {
+        size_t count;
+        double mean;
+        double rms;     /* standard deviation about the mean */
+        double min;
+        double max;
+    };
+
+    /* Sets the window length in samples and resets */
+    void set_window(size_t window);
+    size_t window() const { return window_size; }
+
+    void reset();
+    void add(double value);
+
+    Stats stats() const;
+
+    /* Fills adev[k] with the non-overlapping Allan deviation at an averaging
+     * time of 2^k samples, or 0 where there are too few samples yet */
+    void allan_deviation(double adev[num_taus]) const;
+
+private:
+    size_t window_size = 0;
+
+    /* Welford's running mean and sum of squared deviations */
+    size_t count = 0;
+    double mean = 0;
+    double m2 = 0;
+
+    /* The window, oldest sample at index next once it is full */
+    std::vector<double> samples;
+    size_t next = 0;
+    size_t total = 0;           /* samples added since reset */
+    size_t removed = 0;         /* samples removed since the last refresh */
+
+    /* Sample numbers and values that can still become the window's
+     * minimum and maximum, monotonic from front to back */
+    std::deque<std::pair<size_t, double>> min_candidates, max_candidates;
+    double all_min = 0, all_max = 0;
+
+    /* One octave of averaging time. Consecutive block averages are paired
+     * into the blocks of the next octave */
+    struct Octave {
+        double previous = 0;    /* last block average */
+        bool has_previous = false;
+        double pending = 0;     /* first half of the next octave's block */
+        bool has_pending = false;
+        double sum_squares = 0; /* of differences of consecutive averages */
+        size_t differences = 0;
+    };
+    Octave octaves[num_taus];
+
+    void add_window(double value);
+    void remove_window(double value);
+    void refresh();
+    void add_allan(double value);
+};
+
+#endif /* TLBC2STABILITY_H */
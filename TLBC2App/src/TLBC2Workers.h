@@ -0,0 +1,128 @@
+#ifndef TLBC2WORKERS_H
+#define TLBC2WORKERS_H
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include <epicsEvent.h>
+#include <epicsGuard.h>
+#include <epicsMutex.h>
+#include <epicsThread.h>
+
+/* A fixed set of threads for splitting per-frame image work into row ranges.
+ *
+ * parallel_for() is meant to be called by one thread at a time; concurrent
+ * callers are serialized. The calling thread takes the first range itself,
+ * so a pool of size 1 has no helper threads and runs everything inline. */
+class WorkerPool {
+public:
+    WorkerPool(const std::string &name, unsigned size)
+    {
+        size = std::max(size, 1u);
+
+        for (unsigned i = 1; i < size; i++)
+            workers.emplace_back(new Worker(*this, i, name + "-" + std::to_string(i)));
+
+        for (auto &worker : workers)
+            worker->thread.start();
+    }
+
+    ~WorkerPool()
+    {
+        exiting = true;
+
+        for (auto &worker : workers)
+            worker->start.trigger();
+
+        /* the epicsThread destructors wait for the threads to exit */
+        workers.clear();
+    }
+
+    unsigned size() const
+    {
+        return workers.size() + 1;
+    }
+
+    /* Splits [0, n) into at most size() ranges of at least min_chunk items
+     * and calls f(chunk, begin, end) on each, returning once all are done.
+     * chunk numbers the ranges from 0 */
+    template<typename F>
+    void parallel_for(size_t n, size_t min_chunk, F &&f)
+    {
+        epicsGuard<epicsMutex> guard(mutex);
+
+        size_t chunks = std::min<size_t>(size(), std::max<size_t>(n / std::max<size_t>(min_chunk, 1), 1));
+
+        if (chunks <= 1) {
+            f(size_t(0), size_t(0), n);
+            return;
+        }
+
+        job.n = n;
+        job.chunks = chunks;
+        job.context = &f;
+        job.invoke = [](void *context, size_t chunk, size_t begin, size_t end) {
+            (*static_cast<std::remove_reference_t<F> *>(context))(chunk, begin, end);
+        };
+        pending = chunks - 1;
+
+        for (size_t i = 1; i < chunks; i++)
+            workers[i - 1]->start.trigger();
+
+        job.run(0);
+        done.wait();
+    }
+
+private:
+    struct Job {
+        size_t n = 0;
+        size_t chunks = 1;
+        void *context = nullptr;
+        void (*invoke)(void *, size_t, size_t, size_t) = nullptr;
+
+        void run(size_t chunk)
+        {
+            invoke(context, chunk, n * chunk / chunks, n * (chunk + 1) / chunks);
+        }
+    };
+
+    struct Worker: epicsThreadRunable {
+        WorkerPool &pool;
+        size_t index;
+        epicsEvent start;
+        epicsThread thread;
+
+        Worker(WorkerPool &pool, size_t index, const std::string &name)
+            : pool(pool), index(index),
+              thread(*this, name.c_str(),
+                     epicsThreadGetStackSize(epicsThreadStackMedium),
+                     epicsThreadPriorityHigh)
+        {}
+
+        void run() override
+        {
+            while (true) {
+                start.wait();
+                if (pool.exiting)
+                    return;
+
+                pool.job.run(index);
+                if (--pool.pending == 0)
+                    pool.done.trigger();
+            }
+        }
+    };
+
+    epicsMutex mutex;
+    Job job;
+    std::atomic<size_t> pending{0};
+    epicsEvent done;
+    std::atomic<bool> exiting{false};
+    std::vector<std::unique_ptr<Worker>> workers;
+};
+
+#endif /* TLBC2WORKERS_H */
@@ -0,0 +1,78 @@
+/* Stand-in for the vendor TLBC1_Calculations.h used by simulated builds.
+ * Only the members the driver reads are declared; their names and types
+ * follow the vendor header. */
+#ifndef TLBC2_SIM_TLBC1_CALCULATIONS_H
+#define TLBC2_SIM_TLBC1_CALCULATIONS_H
+
+#include "visa.h"
+
+#define TLBC1_MAX_ROWS      2992
+#define TLBC1_MAX_COLUMNS   4096
+
+typedef struct {
+    ViBoolean isValid;
+
+    ViReal64 baseLevel;
+    ViReal64 lightShieldedPixelMeanIntensity;
+    ViReal64 saturation;
+
+    ViUInt16 peakPositionX;
+    ViUInt16 peakPositionY;
+    ViReal32 centroidPositionX;
+    ViReal32 centroidPositionY;
+
+    ViReal64 beamWidthIsoX;
+    ViReal64 beamWidthIsoY;
+    ViReal64 beamWidthIsoXSimple;
+    ViReal64 beamWidthIsoYSimple;
+    ViReal32 beamWidthClipX;
+    ViReal32 beamWidthClipY;
+    ViReal64 ellipticityIso;
+    ViReal64 azimuthAngle;
+
+    ViReal32 ellipseDiaMin;
+    ViReal32 ellipseDiaMax;
+    ViReal32 ellipseDiaMean;
+    ViReal32 ellipseOrientation;
+    ViReal32 ellipseEllipticity;
+    ViReal32 ellipseEccentricity;
+    ViReal32 ellipseCenterX;
+    ViReal32 ellipseCenterY;
+    ViReal32 ellipseFitAmplitude;
+    ViReal32 rotAngleEllipseX;
+    ViReal32 rotAngleEllipseY;
+    ViReal32 ellipseWidthIsoX;
+    ViReal32 ellipseWidthIsoY;
+
+    ViReal32 totalPower;
+    ViReal32 peakPowerDensity;
+
+    ViReal32 gaussianFitCentroidPositionX;
+    ViReal32 gaussianFitCentroidPositionY;
+    ViReal32 gaussianFitRatingX;
+    ViReal32 gaussianFitRatingY;
+    ViReal32 gaussianFitDiameterX;
+    ViReal32 gaussianFitDiameterY;
+
+    ViReal32 calcAreaCenterX;
+    ViReal32 calcAreaCenterY;
+    ViReal32 calcAreaWidth;
+    ViReal32 calcAreaHeight;
+    ViReal64 calcAreaAngle;
+    ViReal64 calcAreaLineOffset;
+
+    ViReal32 profilePeakValueX;
+    ViReal32 profilePeakValueY;
+    ViUInt16 profilePeakPosX;
+    ViUInt16 profilePeakPosY;
+
+    ViReal64 effectiveArea;
+    ViReal64 effectiveBeamDiameter;
+
+    ViReal64 temperature;
+
+    ViReal32 besselFitRatingX;
+    ViReal32 besselFitRatingY;
+} TLBC1_Calculations;
+
+#endif /* TLBC2_SIM_TLBC1_CALCULATIONS_H */
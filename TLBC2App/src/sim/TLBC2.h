@@ -0,0 +1,71 @@
+/* Stand-in for the vendor TLBC2.h used by simulated builds. Declares the
+ * subset of the TLBC2 API that the driver calls; TLBC2Sim.cpp provides the
+ * implementation. */
+#ifndef TLBC2_SIM_TLBC2_H
+#define TLBC2_SIM_TLBC2_H
+
+#include "visa.h"
+#include "TLBC1_Calculations.h"
+
+#define TLBC2_INV_DEVICE_HANDLE         ((ViSession)0)
+#define TLBC2_ERR_DESCR_BUFFER_SIZE     512
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+ViStatus TLBC2_get_device_count(ViSession vi, ViUInt32 *deviceCount);
+ViStatus TLBC2_get_device_information(ViSession vi, ViUInt32 deviceIndex,
+                                      ViChar manufacturer[], ViChar modelName[],
+                                      ViChar serialNumber[], ViBoolean *deviceAvailable,
+                                      ViChar resourceName[]);
+ViStatus TLBC2_init(ViRsrc resourceName, ViBoolean IDQuery, ViBoolean resetDevice,
+                    ViSession *vi);
+ViStatus TLBC2_close(ViSession vi);
+ViStatus TLBC2_revision_query(ViSession vi, ViChar instrumentDriverRevision[],
+                              ViChar firmwareRevision[]);
+ViStatus TLBC2_error_message(ViSession vi, ViStatus statusCode, ViChar description[]);
+
+ViStatus TLBC2_get_exposure_time(ViSession vi, ViReal64 *exposureTime);
+ViStatus TLBC2_set_exposure_time(ViSession vi, ViReal64 exposureTime);
+ViStatus TLBC2_get_exposure_time_range(ViSession vi, ViReal64 *minimum, ViReal64 *maximum);
+ViStatus TLBC2_get_gain(ViSession vi, ViReal64 *gain);
+ViStatus TLBC2_set_gain(ViSession vi, ViReal64 gain);
+ViStatus TLBC2_get_gain_range(ViSession vi, ViReal64 *minimum, ViReal64 *maximum);
+ViStatus TLBC2_get_temperature(ViSession vi, ViReal64 *temperature);
+ViStatus TLBC2_get_attenuation(ViSession vi, ViReal64 *attenuation);
+ViStatus TLBC2_set_attenuation(ViSession vi, ViReal64 attenuation);
+ViStatus TLBC2_get_auto_exposure(ViSession vi, ViBoolean *autoExposure);
+ViStatus TLBC2_set_auto_exposure(ViSession vi, ViBoolean autoExposure);
+ViStatus TLBC2_get_auto_calculation_area_clip_level(ViSession vi, ViReal64 *clipLevel);
+ViStatus TLBC2_set_auto_calculation_area_clip_level(ViSession vi, ViReal64 clipLevel);
+ViStatus TLBC2_get_clip_level(ViSession vi, ViReal64 *clipLevel);
+ViStatus TLBC2_set_clip_level(ViSession vi, ViReal64 clipLevel);
+ViStatus TLBC2_get_wavelength(ViSession vi, ViReal64 *wavelength);
+ViStatus TLBC2_set_wavelength(ViSession vi, ViReal64 wavelength);
+ViStatus TLBC2_get_wavelength_range(ViSession vi, ViReal64 *minimum, ViReal64 *maximum);
+
+ViStatus TLBC2_get_ambient_light_correction_mode(ViSession vi, ViUInt8 *mode);
+ViStatus TLBC2_set_ambient_light_correction_mode(ViSession vi, ViUInt8 mode);
+ViStatus TLBC2_get_ambient_light_correction_status(ViSession vi, ViUInt8 *status);
+ViStatus TLBC2_run_ambient_light_correction(ViSession vi);
+
+ViStatus TLBC2_get_calculation_area_mode(ViSession vi, ViBoolean *automatic, ViUInt8 *form);
+ViStatus TLBC2_set_calculation_area_mode(ViSession vi, ViBoolean automatic, ViUInt8 form);
+ViStatus TLBC2_set_user_calculation_area(ViSession vi, ViReal32 centerX, ViReal32 centerY,
+                                         ViReal32 width, ViReal32 height, ViReal64 angle);
+ViStatus TLBC2_get_roi(ViSession vi, ViUInt16 *left, ViUInt16 *top,
+                       ViUInt16 *width, ViUInt16 *height);
+ViStatus TLBC2_set_roi(ViSession vi, ViUInt16 left, ViUInt16 top,
+                       ViUInt16 width, ViUInt16 height);
+
+ViStatus TLBC2_request_new_measurement(ViSession vi);
+ViStatus TLBC2_get_scan_data(ViSession vi, TLBC1_Calculations *scanData);
+ViStatus TLBC2_get_image(ViSession vi, ViUInt8 imageData[], ViUInt16 *width,
+                         ViUInt16 *height, ViUInt8 *bytesPerPixel);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TLBC2_SIM_TLBC2_H */
@@ -0,0 +1,39 @@
+/* Minimal subset of the VISA type definitions used by the TLBC2 API, for
+ * builds against the simulated backend where no VISA installation exists. */
+#ifndef TLBC2_SIM_VISA_H
+#define TLBC2_SIM_VISA_H
+
+#include <stdint.h>
+
+typedef int32_t  ViStatus;
+typedef uint32_t ViSession;
+typedef uint32_t ViObject;
+typedef int8_t   ViInt8;
+typedef uint8_t  ViUInt8;
+typedef int16_t  ViInt16;
+typedef uint16_t ViUInt16;
+typedef int32_t  ViInt32;
+typedef uint32_t ViUInt32;
+typedef float    ViReal32;
+typedef double   ViReal64;
+typedef uint16_t ViBoolean;
+typedef char     ViChar;
+typedef ViChar  *ViString;
+typedef ViString ViRsrc;
+
+typedef ViBoolean *ViPBoolean;
+
+#define VI_SUCCESS      ((ViStatus)0)
+#define VI_NULL         0
+#define VI_TRUE         ((ViBoolean)1)
+#define VI_FALSE        ((ViBoolean)0)
+#define VI_ON           VI_TRUE
+#define VI_OFF          VI_FALSE
+
+#define VI_ERROR        ((ViStatus)0x80000000UL)
+#define VI_ERROR_RSRC_NFOUND    ((ViStatus)(VI_ERROR + 0x3FFF0011UL))
+#define VI_ERROR_INV_OBJECT     ((ViStatus)(VI_ERROR + 0x3FFF000EUL))
+#define VI_ERROR_PARAMETER1     ((ViStatus)(VI_ERROR + 0x3FFC0001UL))
+#define VI_ERROR_PARAMETER2     ((ViStatus)(VI_ERROR + 0x3FFC0002UL))
+
+#endif /* TLBC2_SIM_VISA_H */
@@ -0,0 +1,10 @@
+# One profiler of the multi-device benchmark, loaded by st_bench.cmd
+#
+# The following parameters must be defined before loading this configuration:
+#
+# $(N)
+# Device number, 0 to 3. Selects the simulated profiler with serial number
+# SIM100$(N) and names the port TLBC2_$(N).
+
+TLBC2Config("TLBC2_$(N)", 4096, 2992, 0, 0, "SIM100$(N)")
+dbLoadRecords("BC210CU.template", "P=$(PREFIX)$(N):, R=cam1:, PORT=TLBC2_$(N), ADDR=0, TIMEOUT=1")
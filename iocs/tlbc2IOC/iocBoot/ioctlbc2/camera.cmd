@@ -13,11 +13,17 @@
 #
 # $(MAX_IMAGE_HEIGHT)
 # The maximum image height.
+#
+# Optional parameters:
+#
+# $(DEVICE)
+# Serial number or VISA resource name of the profiler to use.
+# Defaults to the first profiler not used by another port.
 
 dbLoadDatabase "../../dbd/tlbc2.dbd"
 tlbc2_registerRecordDeviceDriver(pdbbase)
 
 epicsEnvSet("EPICS_DB_INCLUDE_PATH", "$(ADCORE)/db;$(ADTLBC2)/db")
 
-TLBC2Config("$(PORT)", "$(MAX_IMAGE_WIDTH)", "$(MAX_IMAGE_HEIGHT)", 0, 0)
+TLBC2Config("$(PORT)", "$(MAX_IMAGE_WIDTH)", "$(MAX_IMAGE_HEIGHT)", 0, 0, "$(DEVICE=)")
 dbLoadRecords("BC210CU.template", "P=$(PREFIX), R=cam1:, PORT=$(PORT), ADDR=0, TIMEOUT=1")
@@ -33,6 +33,15 @@
 # This should be consistent with IMAGE_ASYN_TYPE.
 # Defaults to USHORT.
 #
+# $(MAX_PREVIEW_PIXELS)
+# The maximum number of pixels of the binned preview sent through channel
+# access on address 1 of the driver.
+# Defaults to $(MAX_IMAGE_PIXELS), which allows any binning.
+#
+# $(PREVIEW_ASYN_TYPE), $(PREVIEW_WAVEFORM_TYPE)
+# As IMAGE_ASYN_TYPE and IMAGE_WAVEFORM_TYPE, for the preview.
+# Default to Int32 and LONG, which hold the binned sums.
+#
 # $(QSIZE)
 # The queue size for all plugins.
 # Defaults to 20
@@ -53,11 +62,16 @@
 NDStdArraysConfigure("Image1", $(QSIZE=20), 0, $(PORT), 0, 0, 0, 0, $(MAX_THREADS=4))
 dbLoadRecords("NDStdArrays.template", "P=$(PREFIX), R=image1:, PORT=Image1, ADDR=0, TIMEOUT=1, NDARRAY_PORT=$(PORT), TYPE=$(IMAGE_ASYN_TYPE=Int16), FTVL=$(IMAGE_WAVEFORM_TYPE=USHORT), NELEMENTS=$(MAX_IMAGE_PIXELS)")
 
+# Channel Access conversion of the driver's binned preview (address 1)
+NDStdArraysConfigure("Preview1", $(QSIZE=20), 0, $(PORT), 1, 0, 0, 0, $(MAX_THREADS=4))
+dbLoadRecords("NDStdArrays.template", "P=$(PREFIX), R=preview1:, PORT=Preview1, ADDR=0, TIMEOUT=1, NDARRAY_PORT=$(PORT), NDARRAY_ADDR=1, TYPE=$(PREVIEW_ASYN_TYPE=Int32), FTVL=$(PREVIEW_WAVEFORM_TYPE=LONG), NELEMENTS=$(MAX_PREVIEW_PIXELS=$(MAX_IMAGE_PIXELS))")
+
 # Create 1 ROI plugin
 NDROIConfigure("ROI1", $(QSIZE=20), 0, "$(PORT)", 0, 0, 0, 0, 0, $(MAX_THREADS=4))
 dbLoadRecords("NDROI.template", "P=$(PREFIX), R=ROI1:, PORT=ROI1, ADDR=0, TIMEOUT=1, NDARRAY_PORT=$(PORT)")
 
-# Create 1 statistics plugin with time series
+# Create 1 statistics plugin with time series. The driver publishes the X
+# and Y profiles itself (PROFILE_ENABLE), so these are not needed for them
 NDStatsConfigure("STATS1", $(QSIZE=20), 0, "ROI1", 0, 0, 0, 0, 0, $(MAX_THREADS=4))
 dbLoadRecords("NDStats.template", "P=$(PREFIX), R=Stats1:, PORT=STATS1, ADDR=0, TIMEOUT=1, HIST_SIZE=256, XSIZE=$(MAX_IMAGE_WIDTH), YSIZE=$(MAX_IMAGE_HEIGHT), NCHANS=$(NCHANS=2048), NDARRAY_PORT=ROI1")
 NDTimeSeriesConfigure("STATS1_TS", $(QSIZE=20), 0, "STATS1", 1, 23, 0, 0, 0, 0)
@@ -0,0 +1,43 @@
+#!../../bin/linux-x86_64/tlbc2
+
+# Streams several simulated profilers at once from one IOC and prints the
+# aggregate frame rate and the CPU use of the IOC. Comment out devices to
+# benchmark fewer of them.
+
+< envPaths
+
+epicsEnvSet("PREFIX", "CED:A:TLBC2:BENCH")
+
+dbLoadDatabase "../../dbd/tlbc2.dbd"
+tlbc2_registerRecordDeviceDriver(pdbbase)
+
+epicsEnvSet("EPICS_DB_INCLUDE_PATH", "$(ADCORE)/db;$(ADTLBC2)/db")
+
+# 4 devices with 1920x1200 12 bit sensors and 1 ms per SDK call
+TLBC2SimConfig(4, 1920, 1200, 12, 0.001, 0)
+
+iocshLoad("bench-camera.cmd", "N=0")
+iocshLoad("bench-camera.cmd", "N=1")
+iocshLoad("bench-camera.cmd", "N=2")
+iocshLoad("bench-camera.cmd", "N=3")
+
+iocInit()
+
+dbpf("$(PREFIX)0:cam1:AcquireTime", "0.001")
+dbpf("$(PREFIX)1:cam1:AcquireTime", "0.001")
+dbpf("$(PREFIX)2:cam1:AcquireTime", "0.001")
+dbpf("$(PREFIX)3:cam1:AcquireTime", "0.001")
+
+dbpf("$(PREFIX)0:cam1:ImageMode", "Continuous")
+dbpf("$(PREFIX)1:cam1:ImageMode", "Continuous")
+dbpf("$(PREFIX)2:cam1:ImageMode", "Continuous")
+dbpf("$(PREFIX)3:cam1:ImageMode", "Continuous")
+
+dbpf("$(PREFIX)0:cam1:Acquire", "1")
+dbpf("$(PREFIX)1:cam1:Acquire", "1")
+dbpf("$(PREFIX)2:cam1:Acquire", "1")
+dbpf("$(PREFIX)3:cam1:Acquire", "1")
+
+# let the pipelines fill before measuring
+epicsThreadSleep(2)
+TLBC2Benchmark(10)